@@ -0,0 +1,154 @@
+//
+//  alloc_profiler.cpp
+//  TowerMac
+//
+
+#include "alloc_profiler.hpp"
+
+#ifdef TM_ALLOC_PROFILE
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+namespace
+{
+	const char *kPhaseNames[alloc_profiler::kPhaseCount] = { "other", "spawns", "towers", "mobs", "targets", "bullets", "cleanup" };
+
+	struct counter
+	{
+		std::atomic<size_t> count{ 0 };
+		std::atomic<size_t> bytes{ 0 };
+	};
+
+		//	Plain globals, so they are ready before any static constructor allocates
+	counter tick_counters[alloc_profiler::kPhaseCount];		///	Since the last end_tick()
+	bool strict = false;
+
+		//	Per thread, so the audio, music and definition threads are neither counted in
+		//	the phase of the simulation thread nor caught by its allocation free sections
+	thread_local int current_phase = alloc_profiler::kOther;
+	thread_local int no_alloc_depth = 0;
+
+		//	Totals, only touched by end_tick()
+	size_t total_count[alloc_profiler::kPhaseCount];
+	size_t total_bytes[alloc_profiler::kPhaseCount];
+	size_t worst_count[alloc_profiler::kPhaseCount];		///	Worst tick
+	size_t ticks = 0;
+	size_t ticks_allocating = 0;
+	std::ostream *trace = nullptr;
+
+	thread_local bool reporting = false;	///	Do not count our own allocations
+
+	void *count_allocation( size_t size )
+	{
+		if (!reporting)
+		{
+			auto phase = current_phase;
+			tick_counters[phase].count.fetch_add( 1, std::memory_order_relaxed );
+			tick_counters[phase].bytes.fetch_add( size, std::memory_order_relaxed );
+
+			if (strict && no_alloc_depth>0)
+			{
+				fprintf( stderr, "Allocation of %zu bytes in an allocation free section (phase %s)\n", size, kPhaseNames[phase] );
+				abort();
+			}
+		}
+
+		auto p = malloc( size?size:1 );
+		if (!p)
+			throw std::bad_alloc();
+		return p;
+	}
+}
+
+void *operator new( size_t size ) { return count_allocation( size ); }
+void *operator new[]( size_t size ) { return count_allocation( size ); }
+void operator delete( void *p ) noexcept { free( p ); }
+void operator delete[]( void *p ) noexcept { free( p ); }
+void operator delete( void *p, size_t ) noexcept { free( p ); }
+void operator delete[]( void *p, size_t ) noexcept { free( p ); }
+
+alloc_profiler::no_alloc::no_alloc() { no_alloc_depth++; }
+alloc_profiler::no_alloc::~no_alloc() { no_alloc_depth--; }
+
+void alloc_profiler::enter( ePhase phase )
+{
+	current_phase = phase;
+}
+
+void alloc_profiler::set_strict( bool s )
+{
+	strict = s;
+}
+
+void alloc_profiler::set_trace( std::ostream *t )
+{
+	trace = t;
+}
+
+void alloc_profiler::end_tick()
+{
+	reporting = true;
+
+	size_t count[kPhaseCount];
+	size_t bytes[kPhaseCount];
+	size_t tick_count = 0;
+	size_t tick_bytes = 0;
+	for (int i=0;i!=kPhaseCount;i++)
+	{
+		count[i] = tick_counters[i].count.exchange( 0 );
+		bytes[i] = tick_counters[i].bytes.exchange( 0 );
+		total_count[i] += count[i];
+		total_bytes[i] += bytes[i];
+		if (count[i]>worst_count[i])
+			worst_count[i] = count[i];
+		tick_count += count[i];
+		tick_bytes += bytes[i];
+	}
+
+	if (tick_count)
+	{
+		ticks_allocating++;
+		if (trace)
+		{
+			*trace << "alloc tick " << ticks << ":";
+			for (int i=0;i!=kPhaseCount;i++)
+				if (count[i])
+					*trace << " " << kPhaseNames[i] << "=" << count[i] << "/" << bytes[i] << "b";
+			*trace << " total=" << tick_count << "/" << tick_bytes << "b\n";
+		}
+	}
+	ticks++;
+
+	reporting = false;
+}
+
+size_t alloc_profiler::allocations()
+{
+	size_t res = 0;
+	for (int i=0;i!=kPhaseCount;i++)
+		res += total_count[i]+tick_counters[i].count.load( std::memory_order_relaxed );
+	return res;
+}
+
+void alloc_profiler::report( std::ostream &out )
+{
+	reporting = true;
+
+	out << "alloc " << ticks << " ticks, " << ticks_allocating << " allocating\n";
+	for (int i=0;i!=kPhaseCount;i++)
+	{
+		out << "alloc " << kPhaseNames[i]
+			<< " count=" << total_count[i]
+			<< " bytes=" << total_bytes[i]
+			<< " per_tick=" << (ticks?(double)total_count[i]/ticks:0)
+			<< " worst_tick=" << worst_count[i] << "\n";
+	}
+
+	reporting = false;
+}
+
+#endif
@@ -0,0 +1,62 @@
+//
+//  alloc_profiler.hpp
+//  TowerMac
+//
+
+#ifndef ALLOC_PROFILER_INCLUDED__
+#define ALLOC_PROFILER_INCLUDED__
+
+#include <cstddef>
+#include <iosfwd>
+
+///	Counts the heap allocations of each phase of a simulation tick
+///	Only active when built with -DTM_ALLOC_PROFILE (see 'make bench-alloc'), which replaces the global operator new
+///	The phase and the allocation free sections belong to the thread that sets them: other threads count in their own phase
+///	Otherwise, all of this compiles to nothing
+class alloc_profiler
+{
+public:
+	///	The phases of a tick, as in simulation::step
+	enum ePhase
+	{
+		kOther,			///	Anything outside of a tick
+		kSpawns,		///	mob_scheduler::step
+		kTowers,
+		kMobs,
+		kTargets,
+		kBullets,
+		kCleanup,
+		kPhaseCount
+	};
+
+	///	A section that must not allocate: in strict mode, an allocation aborts the program
+	class no_alloc
+	{
+	public:
+#ifdef TM_ALLOC_PROFILE
+		no_alloc();
+		~no_alloc();
+#else
+		no_alloc() {}
+#endif
+		no_alloc( const no_alloc & ) = delete;
+	};
+
+#ifdef TM_ALLOC_PROFILE
+	static void enter( ePhase phase );
+	static void end_tick();
+	static void set_strict( bool strict );
+	static void set_trace( std::ostream *trace );	///	If set, prints the allocations of each tick that has some
+	static void report( std::ostream &out );
+	static size_t allocations();		///	Counted since the start, in all the phases
+#else
+	static void enter( ePhase ) {}
+	static void end_tick() {}
+	static void set_strict( bool ) {}
+	static void set_trace( std::ostream * ) {}
+	static void report( std::ostream & ) {}
+	static size_t allocations() { return 0; }
+#endif
+};
+
+#endif
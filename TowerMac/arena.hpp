@@ -0,0 +1,107 @@
+//
+//  arena.hpp
+//  TowerMac
+//
+
+#ifndef ARENA_INCLUDED__
+#define ARENA_INCLUDED__
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+///	Memory for the entities of a wave
+///	Objects are carved out of large blocks, and recycled through a free list per type
+///	Destroying the arena releases the blocks without running any destructor,
+///	so objects allocated here must not own memory outside of the arena
+class arena
+{
+	static const size_t kBlockSize = 64*1024;
+	static const size_t kHeader = alignof(std::max_align_t);	///	In front of each object: the index of its type
+
+	std::vector<char *> blocks_;
+	char *current_ = nullptr;
+	char *end_ = nullptr;
+
+	std::vector<void *> free_;		///	Free lists, by type index. The link is stored in the object
+	size_t allocated_ = 0;			///	Live objects, for checks
+
+	std::mutex mutex_;				///	Bullets can be cloned from several threads
+
+	///	A different small integer for each type
+	static size_t next_type() { static std::atomic<size_t> next{ 0 }; return next++; }
+	template <typename T> static size_t type_index() { static const size_t index = next_type(); return index; }
+
+	void *take( size_t type, size_t size )
+	{
+		std::lock_guard<std::mutex> guard( mutex_ );
+		allocated_++;
+		if (type<free_.size() && free_[type])
+		{
+			auto p = free_[type];
+			free_[type] = *(void **)p;
+			return p;
+		}
+
+		size = (size+kHeader+kHeader-1)/kHeader*kHeader;
+		if (current_+size>end_)
+		{
+			auto block_size = std::max( kBlockSize, size );
+			current_ = (char *)::operator new( block_size );		//	Not malloc, so the allocation profiler sees the blocks
+			blocks_.push_back( current_ );
+			end_ = current_+block_size;
+		}
+		auto p = current_;
+		current_ += size;
+		*(size_t *)p = type;
+		return p+kHeader;
+	}
+
+	void give( void *p )
+	{
+		std::lock_guard<std::mutex> guard( mutex_ );
+		allocated_--;
+		auto type = *(size_t *)((char *)p-kHeader);
+		if (type>=free_.size())
+			free_.resize( type+1 );
+		*(void **)p = free_[type];
+		free_[type] = p;
+	}
+
+public:
+	arena() {}
+	arena( const arena & ) = delete;
+
+	///	Releases everything at once
+	~arena()
+	{
+		for (auto b:blocks_)
+			::operator delete( b );
+	}
+
+	template <typename T, typename ... Args> T *create( Args && ... args )
+	{
+		static_assert( sizeof(T)>=sizeof(void *), "Too small to be recycled" );
+		static_assert( alignof(T)<=kHeader, "Alignment not supported" );
+		return new (take( type_index<T>(), sizeof(T) )) T( std::forward<Args>( args )... );
+	}
+
+	///	Destroys the object, and keeps its memory for the next object of the same type
+	///	The type is the one it was created with, even if p is a base class (with a virtual destructor)
+	template <typename T> void destroy( T *p )
+	{
+		if (!p)
+			return;
+		void *memory = dynamic_cast<void *>( p );
+		p->~T();
+		give( memory );
+	}
+
+	size_t allocated() const { return allocated_; }
+	size_t blocks() const { return blocks_.size(); }
+};
+
+#endif
@@ -0,0 +1,21 @@
+0 
+
+17
+  tower connector0 
+  tower rom-hi0 
+  tower rom-lo0 
+  tower iwm0 
+  tower connector0 
+  tower rom-hi0 
+  tower rom-lo0 
+  tower iwm0 
+  tower connector0 
+  tower rom-hi0 
+  tower rom-lo0 
+  tower iwm0 
+  tower connector0 
+  tower rom-hi0 
+  tower rom-lo0 
+  tower iwm0 
+  cooldown 
+
@@ -0,0 +1,9 @@
+0 
+
+5
+  tower connector0 
+  tower rom-hi0 
+  tower rom-lo0 
+  tower iwm0 
+  cooldown 
+
@@ -21,6 +21,8 @@ public:
 		image_.render( location_ );
 	}
 
+	sprite get_sprite() const { return { &image_, location_, location_ }; }
+
 	bool damage( size_t damage )
 	{
 		if (damage>=hp_)
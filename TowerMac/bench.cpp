@@ -0,0 +1,208 @@
+//
+//  bench.cpp
+//  TowerMac
+//
+//  Headless replay of a wave, to compare the simulation built with double, float or fixed point math
+//  and the bullet update spread on several threads (see 'make bench' and 'make bench-scaling')
+//  Arguments: wave, max ticks, threads, tower cooldown, bullets per chunk of the update
+//  A short cooldown and small chunks give the bullet update enough chunks to spread on the threads
+//  With 'flow' as the only argument, measures the flow field updates instead (see 'make bench-flow')
+//
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include <SDL2/SDL.h>
+
+SDL_Renderer *gRenderer = nullptr;
+
+#include "simulation.hpp"
+#include "tower.hpp"
+#include "mob.hpp"
+#include "bullet.hpp"
+#include "game_def.hpp"
+#include "scheduler.hpp"
+#include "thread_pool.hpp"
+#include "alloc_profiler.hpp"
+#include "logger.hpp"
+#include "flow_field.hpp"
+
+#if defined(TM_SCALAR_FIXED)
+static const char *kScalarName = "fixed";
+#elif defined(TM_SCALAR_FLOAT)
+static const char *kScalarName = "float";
+#else
+static const char *kScalarName = "double";
+#endif
+
+///	Mixes the pixel positions of everything alive, so runs can be compared across compilers and machines
+static uint64_t checksum( uint64_t h, simulation &simulation )
+{
+	auto mix = [&]( size_t v ) { h = (h^v)*0x100000001b3; };
+	for (auto m=simulation.get_mobs()->begin();m!=simulation.get_mobs()->end();m=m->next())
+	{
+		auto p = m->location();
+		mix( p.x ); mix( p.y );
+	}
+	for (auto b=simulation.get_bullets()->begin();b!=simulation.get_bullets()->end();b=b->next())
+	{
+		point p = b->position_;
+		mix( p.x ); mix( p.y );
+	}
+	mix( simulation.get_base().get_hp() );
+	return h;
+}
+
+///	Mixes the whole field, to compare incremental updates with a full computation
+static uint64_t checksum( const flow_field &field )
+{
+	uint64_t h = 0xcbf29ce484222325;
+	for (size_t y=0;y!=field.height();y++)
+		for (size_t x=0;x!=field.width();x++)
+		{
+			point p{ x+kMapX, y+kMapY };
+			h = (h^field.distance( p ))*0x100000001b3;
+			h = (h^field.direction( p ))*0x100000001b3;
+		}
+	return h;
+}
+
+///	The flow field of the map, with a tower on every spot: full computation, then removing and
+///	adding back each tower incrementally, checked against a full computation each time
+static int bench_flow()
+{
+	const size_t kRuns = 50;
+	using clock = std::chrono::steady_clock;
+	auto us = []( clock::duration d ) { return std::chrono::duration<double,std::micro>( d ).count(); };
+
+	flow_field field( point{ kMapX, kMapY }, MAP_SIZE, MAP_SIZE );
+	field.set_goal( { { kBaseX, kBaseY }, { kBaseWidth, kBaseHeight } } );
+	auto spots = game_def::spec.spot_defs();
+	for (auto s:spots)
+		field.block( s->footprint() );
+
+	auto start = clock::now();
+	for (size_t i=0;i!=kRuns;i++)
+		field.compute();
+	auto full = us( clock::now()-start )/kRuns;
+
+	clock::duration unblock{}, block{};
+	size_t touched = 0;
+	bool match = true;
+	auto check = [&]
+	{
+		flow_field reference = field;
+		reference.compute();
+		match = match && checksum( reference )==checksum( field );
+	};
+	for (auto s:spots)
+		for (size_t i=0;i!=kRuns;i++)
+		{
+			start = clock::now();
+			field.unblock( s->footprint() );
+			unblock += clock::now()-start;
+			touched += field.touched();
+			if (i==0)
+				check();
+
+			start = clock::now();
+			field.block( s->footprint() );
+			block += clock::now()-start;
+			touched += field.touched();
+			if (i==0)
+				check();
+		}
+
+	auto edits = spots.size()*kRuns;
+	std::cout << "bench flow grid=" << field.width() << "x" << field.height()
+		<< " obstacles=" << spots.size()
+		<< " full=" << full/1000 << "ms"
+		<< " unblock=" << us( unblock )/edits << "us"
+		<< " block=" << us( block )/edits << "us"
+		<< " touched=" << touched/(2*edits) << " cells"
+		<< " match=" << (match?"yes":"NO") << "\n";
+	return match?0:1;
+}
+
+int main( int argc, char *argv[] )
+{
+	if (argc==2 && !strcmp( argv[1], "flow" ))
+		return bench_flow();
+
+	int wave = argc>1?atoi( argv[1] ):0;
+	size_t max_ticks = argc>2?atoi( argv[2] ):100000;
+	size_t threads = argc>3?atoi( argv[3] ):1;
+	tower_stats stats;
+	if (argc>4)
+		stats.cooldown = atoi( argv[4] );
+	size_t chunk = argc>5?atoi( argv[5] ):0;
+
+	if (SDL_Init( SDL_INIT_VIDEO )<0)
+	{
+		std::cerr << "could not initialize sdl2: " << SDL_GetError() << "\n";
+		return 1;
+	}
+		//	Images need a renderer, but nothing is ever drawn
+	auto surface = SDL_CreateRGBSurface( 0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, 0, 0, 0, 0 );
+	gRenderer = SDL_CreateSoftwareRenderer( surface );
+
+		//	Keep the per kill records out of the measure
+	logger::set_level( logger::kWarning );
+
+		//	With 'make bench-alloc': TM_ALLOC_TRACE prints each tick, TM_ALLOC_STRICT aborts on allocations in allocation free sections
+	if (getenv( "TM_ALLOC_TRACE" ))
+		alloc_profiler::set_trace( &std::cout );
+	alloc_profiler::set_strict( getenv( "TM_ALLOC_STRICT" )!=nullptr );
+
+	thread_pool pool( threads );
+	simulation sim;
+	sim.set_thread_pool( &pool );
+	if (chunk)
+		sim.set_bullet_chunk( chunk );
+	for (auto s:game_def::spec.spot_defs())
+		sim.create_tower( s->location, stats );
+	sim.set_target( { 128, 128 } );
+
+	auto scheduler = schedule_wave( game_def::spec.get_wave( wave ) );
+
+	size_t ticks = 0;
+	size_t peak_bullets = 0;
+	uint64_t hash = 0xcbf29ce484222325;
+	std::chrono::steady_clock::duration total{};
+	while (ticks!=max_ticks && !sim.game_over() && (!scheduler.empty() || sim.has_mobs()))
+	{
+		auto start = std::chrono::steady_clock::now();
+		scheduler.step( sim );
+		sim.step();
+		total += std::chrono::steady_clock::now()-start;
+
+		hash = checksum( hash, sim );
+		ticks++;
+
+		size_t bullets = 0;
+		for (auto b=sim.get_bullets()->begin();b!=sim.get_bullets()->end();b=b->next())
+			bullets++;
+		peak_bullets = std::max( peak_bullets, bullets );
+	}
+
+	auto us = std::chrono::duration_cast<std::chrono::microseconds>( total ).count();
+	std::cout << "bench " << kScalarName
+		<< " wave=" << wave
+		<< " threads=" << threads
+		<< " cooldown=" << stats.cooldown
+		<< " ticks=" << ticks
+		<< " total=" << us/1000.0 << "ms"
+		<< " mean=" << (ticks?(double)us/ticks:0) << "us/tick"
+		<< " peak_bullets=" << peak_bullets
+		<< " base=" << sim.get_base().get_hp()
+		<< " checksum=" << std::hex << hash << std::dec << "\n";
+	alloc_profiler::report( std::cout );
+
+	SDL_DestroyRenderer( gRenderer );
+	SDL_FreeSurface( surface );
+	SDL_Quit();
+
+	return 0;
+}
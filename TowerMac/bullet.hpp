@@ -4,7 +4,7 @@
 /**
  * Potential issues:
  *  Too many indirections with step modifiers (array of pointers)
- *  + Heap costs to delete bullet and non-reusability of bullets
+ *  Bullets and modifiers live in the simulation arena, and are recycled inside a wave
  */
 
 #include "core.hpp"
@@ -32,70 +32,104 @@ public:
 	
 	virtual ~step_modifier(){};
 
-	virtual step_modifier *clone() const = 0;
-	virtual void apply( bullet &bullet ) {}
+	virtual step_modifier *clone( arena &arena ) const = 0;
+
+	///	Called during the bullet update, possibly on another thread: new bullets go in 'out'
+	virtual void apply( bullet &bullet, bullet_commands &out ) {}
 };
 
 class bullet : public node<bullet>, public simulated
 {
-	image image_{ "assets/bullets/bullet00-0.bmp" };
+	const image &image_{ default_image() };
+
+	handle handle_ = kNoHandle;		///	Set when registered in the simulation
+	friend class simulation;
 
 	// float speed_ = 2;
 	// mob &target_;
-	size_t damage_ = 50;
+	size_t damage_;
+	uint32_t effects_ = 0;		///	eModifier effect bits, started on the mob hit
 
-	std::vector<step_modifier *> step_modifiers_;
+	///	Fixed storage, as the memory of a bullet must stay in the arena
+	static const size_t kMaxModifiers = 4;
+	step_modifier *step_modifiers_[kMaxModifiers];
+	size_t modifier_count_ = 0;
 
 public:
 	vector2f position_;
 	vector2f direction_;
+	vector2f previous_;		///	Position at the previous tick, for rendering in between
 
-	bullet( simulation &simulation, const point &position, const vector2f &direction ) :
+	bullet( simulation &simulation, const point &position, const vector2f &direction, size_t damage = 50 ) :
 		simulated{ simulation },
+		damage_{ damage },
 		position_{ position },
-		direction_{ direction }
+		direction_{ direction },
+		previous_{ position }
 		{
 		}
 
 	~bullet()
 	{
-		for (auto &m:step_modifiers_)
-			delete m;
+		for (size_t i=0;i!=modifier_count_;i++)
+			simulation_.get_arena().destroy( step_modifiers_[i] );
 	}
 
 	virtual bullet *clone()
 	{
-		auto b = new bullet( simulation_, position_, direction_ );  //  #### todo: copy constructor
-		for (auto m:step_modifiers_)
-			b->step_modifiers_.push_back( m->clone() );
+		auto &arena = simulation_.get_arena();
+		auto b = arena.create<bullet>( simulation_, position_, direction_, damage_ );  //  #### todo: copy constructor
+		for (size_t i=0;i!=modifier_count_;i++)
+			b->add_modifier( step_modifiers_[i]->clone( arena ) );
+		b->effects_ = effects_;
 		return b;
 	}
 
-	void add_modifier( step_modifier *modifier ) { step_modifiers_.push_back( modifier ); }
+	void add_modifier( step_modifier *modifier )
+	{
+		assert( modifier_count_<kMaxModifiers );
+		step_modifiers_[modifier_count_++] = modifier;
+	}
+
+	handle get_handle() const { return handle_; }
 
-	void render()
+	void set_effects( uint32_t effects ) { effects_ = effects; }
+
+	static const image &default_image() { return image::named( "assets/bullets/bullet00-0.bmp" ); }
+
+	sprite get_sprite() const
 	{
-		image_.render( position_ );
+		return { &image_, point( previous_ ), point( position_ ) };
 	}
 
-	void step()
+	///	First half of a step, may run on any thread with other bullets: only the bullet itself changes
+	///	Applies the modifiers, and records the mobs on the way in 'out'
+	void update( size_t index, bullet_commands &out )
 	{
-		for (auto &m:step_modifiers_)
-			m->apply( *this );
+		previous_ = position_;
+		for (size_t i=0;i!=modifier_count_;i++)
+			step_modifiers_[i]->apply( *this, out );
 
-		position_ = position_ + direction_;
-		if (!in_map(position_))
+			//	Test the whole segment travelled this tick, so fast bullets cannot skip over mobs
+		simulation_.find_hits( index, position_, direction_, 10, out.hits );
+	}
+
+	///	Second half, in list order: 'hit' is the nearest mob on the way that is still alive
+	void resolve( mob *hit )
+	{
+		if (hit)
 		{
+				//	Before the damage, which may destroy the mob
+			if (effects_)
+				simulation_.apply_effects( hit, effects_ );
+			hit->damage( damage_ );
 			simulation_.destroy_bullet( this );
 			return;
 		}
 
-		auto mob = simulation_.find_mob( position_, 10 );
-		if (mob)
-		{
-			mob->damage( damage_ );
+		position_ = position_ + direction_;
+		if (!in_map(position_))
 			simulation_.destroy_bullet( this );
-		}
 	}
 };
 
@@ -105,20 +139,23 @@ public:
 	drunken_modifier( const drunken_modifier &o ) : step_modifier( o ) {}
 	drunken_modifier() : step_modifier( tm_random( 0, 63 ) ) {}
 
-	virtual step_modifier *clone() const { return new drunken_modifier( *this ); }
+	virtual step_modifier *clone( arena &arena ) const { return arena.create<drunken_modifier>( *this ); }
 
-	virtual void apply( bullet &bullet )
+	virtual void apply( bullet &bullet, bullet_commands & )
 	{
-		const size_t kDrunkLoop = 64;
-		static vector2f drunk[kDrunkLoop];
-		static bool inited = false;
-		if (!inited)
+		static const size_t kDrunkLoop = 64;
+		struct table
 		{
-			for (int i=0;i!=kDrunkLoop;i++)
-				drunk[i] = vector2f{ cos(i*kDrunkLoop/360.0 )*3, sin(i*kDrunkLoop/360.0 )*3 };
-		}
+			vector2f v[kDrunkLoop];
+			table()
+			{
+				for (int i=0;i!=kDrunkLoop;i++)
+					v[i] = vector2f{ scalar( cos(i*kDrunkLoop/360.0 )*3 ), scalar( sin(i*kDrunkLoop/360.0 )*3 ) };
+			}
+		};
+		static const table drunk;	//	Initialized once, even with several threads
 
-		bullet.position_ = bullet.position_ + drunk[arg0_] /* *step_ */;
+		bullet.position_ = bullet.position_ + drunk.v[arg0_] /* *step_ */;
 		arg0_++;
 		if (arg0_==kDrunkLoop)
 			arg0_ = 0;
@@ -128,11 +165,12 @@ public:
 class accelerating_modifier : public step_modifier
 {
 public:
+	accelerating_modifier() {}
 	accelerating_modifier( const accelerating_modifier &o ) : step_modifier( o ) {}
-	virtual accelerating_modifier *clone() const { return new accelerating_modifier( *this ); }
-	virtual void apply( bullet &bullet )
+	virtual accelerating_modifier *clone( arena &arena ) const { return arena.create<accelerating_modifier>( *this ); }
+	virtual void apply( bullet &bullet, bullet_commands & )
 	{
-		bullet.direction_ = bullet.direction_ * (1+1/32.0);
+		bullet.direction_ = bullet.direction_ * scalar(1+1/32.0);
 	}
 };
 
@@ -148,8 +186,8 @@ class splitting_modifier : public step_modifier
 {
 public:
 	splitting_modifier( const splitting_modifier &o ) : step_modifier( o ) {}
-	virtual splitting_modifier *clone() const { return new splitting_modifier( *this ); }
-	virtual void apply( bullet &bullet )
+	virtual splitting_modifier *clone( arena &arena ) const { return arena.create<splitting_modifier>( *this ); }
+	virtual void apply( bullet &bullet, bullet_commands &out )
 	{
 		if (arg0_>0)
 		{
@@ -170,7 +208,7 @@ public:
 				b->direction_ = new_speed;
 				b->position_ = b->position_+b->direction_;
 
-				bullet.get_simulation().register_bullet( b );
+				out.spawned.push_back( b );
 			}
 		}
 	}
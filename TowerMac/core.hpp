@@ -4,29 +4,36 @@
 #include <cstdint>
 #include <cmath>
 #include <cassert>
+#include <cstdlib>
 
+#include "fixed.hpp"
+
+///	Intrusive list links
+///	Links are node pointers, not T pointers: the list head is a node, but is not a T
 template <class T>
 class node
 {
 public:
-	T *next_;
-	T *prev_;
+	node *next_;
+	node *prev_;
 
-	node() : next_{(T*)this}, prev_{(T*)this} {}
+	node() : next_{this}, prev_{this} {}
 	virtual ~node() {}
 
+	T *next() const { return static_cast<T*>(next_); }
+
 	void remove() { next_->prev_ = prev_; prev_->next_ = next_; }
-	void insert_after( T *prev ) { prev_ = prev; next_ = prev_->next_; prev_->next_ = (T*)this; next_->prev_ = (T*)this; }
+	void insert_after( node *prev ) { prev_ = prev; next_ = prev_->next_; prev_->next_ = this; next_->prev_ = this; }
 };
 
 template <class T>
 class dlist : public node<T>
 {
 public:
-	T *begin() const { return node<T>::next_; };
+	T *begin() const { return node<T>::next(); };
 	T *end() const { return (T*)this; }
-	bool is_empty() const { return begin()==end(); }
-	void add( T *t ) { t->insert_after((T*)this); }
+	bool is_empty() const { return node<T>::next_==this; }
+	void add( T *t ) { t->insert_after( this ); }
 };
 
 const size_t ZoomFactor = 2;
@@ -40,12 +47,25 @@ const size_t kMapX = kMapY;
 
 const size_t kBaseX = 106;
 const size_t kBaseY = 97;
+const size_t kBaseWidth = 31;		///	Size of base.bmp, where the mobs go
+const size_t kBaseHeight = 116;
 
 
 
 
 
-struct vector2f;
+///	The scalar type used by the simulation
+///	Build with -DTM_SCALAR_FIXED for 16.16 fixed point (68k, bit reproducible), or -DTM_SCALAR_FLOAT
+#if defined(TM_SCALAR_FIXED)
+typedef fixed16 scalar;
+#elif defined(TM_SCALAR_FLOAT)
+typedef float scalar;
+#else
+typedef double scalar;
+#endif
+
+template <typename S> struct vector2;
+typedef vector2<scalar> vector2f;
 
 struct point
 {
@@ -53,7 +73,7 @@ struct point
 	size_t y;
 
 //    point operator-( const point &o ) const { return point{ x-o.x, y-o.y }; }
-	vector2f operator/( double v ) const;
+	vector2f operator/( scalar v ) const;
 	operator vector2f() const;
 	
 	bool operator!=( const point &o ) const { return x!=o.x || y!=o.y; }
@@ -81,51 +101,131 @@ struct rect
 	size_t bottom() const { return o.y+s.h; }
 };
 
-struct vector2f
+template <typename S> struct vector2
 {
-	double x;
-	double y;
+	S x;
+	S y;
 
-	vector2f() {}
-	vector2f( double ax, double ay ) : x{ax}, y{ay} {}
-	vector2f( const point &p ) : x{(double)p.x}, y{(double)p.y} {}
+	vector2() {}
+	vector2( S ax, S ay ) : x{ax}, y{ay} {}
+	vector2( const point &p ) : x{ S( p.x ) }, y{ S( p.y ) } {}
 
-	vector2f operator/( double v ) const { return vector2f{ x/v, y/v }; }
-	vector2f operator*( double v ) const { return vector2f{ x*v, y*v }; }
-	vector2f operator+( const vector2f &o ) const { return vector2f{ x+o.x, y+o.y }; }
-	vector2f operator-( const vector2f &o ) const { return vector2f{ x-o.x, y-o.y }; }
+	vector2 operator/( S v ) const { return vector2{ x/v, y/v }; }
+	vector2 operator*( S v ) const { return vector2{ x*v, y*v }; }
+	vector2 operator+( const vector2 &o ) const { return vector2{ x+o.x, y+o.y }; }
+	vector2 operator-( const vector2 &o ) const { return vector2{ x-o.x, y-o.y }; }
 
 	operator point() const { return point{ (size_t)x, (size_t)y }; }
 };
 
-inline point::operator vector2f() const { return vector2f{ (double)x, (double)y }; }
-inline vector2f point::operator/( double v ) const { return vector2f{ x/v, y/v }; }
+inline point::operator vector2f() const { return vector2f{ *this }; }
+inline vector2f point::operator/( scalar v ) const { return vector2f{ *this }/v; }
 
 inline double distance( const point p0, const point p1 )
 {
 	return sqrt( (p0.x-p1.x)*(p0.x-p1.x) + (p0.y-p1.y)*(p0.y-p1.y) );
 }
 
-inline double norm( const vector2f &v )
+template <typename S> S dot( const vector2<S> &a, const vector2<S> &b )
 {
-	return sqrt( v.x*v.x + v.y*v.y );
+	return a.x*b.x + a.y*b.y;
 }
 
-inline double norm( const point &v )
+template <typename S> S norm( const vector2<S> &v )
 {
 	return sqrt( v.x*v.x + v.y*v.y );
 }
 
-inline vector2f normalize( const vector2f &v )
+///	Squares are computed on 64 bits, so the norm of any on-screen vector is exact to the last bit
+template <int SCALE> fixed<SCALE> norm( const vector2<fixed<SCALE>> &v )
+{
+	auto x = (int64_t)v.x.raw();
+	auto y = (int64_t)v.y.raw();
+	return fixed<SCALE>::from_raw( (int32_t)isqrt( (uint64_t)(x*x+y*y) ) );
+}
+
+inline scalar norm( const point &v )
+{
+	return norm( vector2f{ v } );
+}
+
+///	The null vector has no direction, and stays null (fixed point would divide by zero)
+template <typename S> vector2<S> normalize( const vector2<S> &v )
 {
 	auto n = norm( v );
+	if (n==S{})
+		return v;
 	return v/n;
 }
 
 inline vector2f normalize( const point &v )
 {
-	auto n = norm( v );
-	return v/n;
+	return normalize( vector2f{ v } );
+}
+
+///	Checks if the segment [from,from+delta] enters the circle of center c and radius r
+///	If it does, t is set to the fraction of the segment [0-1] where it enters
+template <typename S> bool segment_hits_circle( const vector2<S> &from, const vector2<S> &delta, const vector2<S> &c, S r, double &t )
+{
+	auto f = from-c;
+	auto cc = dot( f, f )-r*r;
+	if (cc<=0)
+	{
+		t = 0;		//	Starts inside
+		return true;
+	}
+	auto b = dot( f, delta );
+	if (b>=0)
+		return false;	//	Moving away
+	auto dd = dot( delta, delta );
+	auto disc = b*b-dd*cc;
+	if (disc<0)
+		return false;	//	Misses
+	t = (-b-sqrt( disc ))/dd;
+	return t<=1;
+}
+
+///	Fixed point version, in 64 bits integers: a 4th power does not fit in 16.16
+///	Uses the closest approach and the half chord instead of solving the quadratic
+template <int SCALE> bool segment_hits_circle( const vector2<fixed<SCALE>> &from, const vector2<fixed<SCALE>> &delta, const vector2<fixed<SCALE>> &c, fixed<SCALE> r, double &t )
+{
+	const int64_t one = fixed<SCALE>::kOne;
+	int64_t fx = (int64_t)from.x.raw()-c.x.raw();
+	int64_t fy = (int64_t)from.y.raw()-c.y.raw();
+	int64_t dx = delta.x.raw();
+	int64_t dy = delta.y.raw();
+	int64_t rr = r.raw();
+
+		//	Bounding box reject, which also keeps all the products below in range
+	if (std::abs( fx )>rr+std::abs( dx ) || std::abs( fy )>rr+std::abs( dy ))
+		return false;
+
+	if (fx*fx+fy*fy<=rr*rr)
+	{
+		t = 0;		//	Starts inside
+		return true;
+	}
+
+	int64_t dd = dx*dx+dy*dy;			//	2*SCALE decimals
+	if ((dd>>SCALE)==0)
+		return false;	//	Not moving
+	int64_t b = fx*dx+fy*dy;			//	2*SCALE decimals
+	if (b>=0)
+		return false;	//	Moving away
+
+	int64_t tc = -b/(dd>>SCALE);		//	Closest approach, SCALE decimals
+	int64_t px = fx+((dx*tc)>>SCALE);
+	int64_t py = fy+((dy*tc)>>SCALE);
+	int64_t miss = rr*rr-(px*px+py*py);
+	if (miss<0)
+		return false;	//	Misses
+
+	int64_t half_chord = ((int64_t)isqrt( (uint64_t)miss )<<SCALE)/(int64_t)isqrt( (uint64_t)dd );
+	int64_t te = tc-half_chord;
+	if (te>one)
+		return false;	//	Not this tick
+	t = te>0?(double)te/one:0;
+	return true;
 }
 
 template <typename V> bool in_map( const V &p ) { return p.x>=kMapX && p.y>=kMapY && p.x<MAP_SIZE+kMapX && p.y<MAP_SIZE+kMapY; }
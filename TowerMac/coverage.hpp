@@ -0,0 +1,86 @@
+//
+//  coverage.hpp
+//  TowerMac
+//
+
+#ifndef COVERAGE_INCLUDED__
+#define COVERAGE_INCLUDED__
+
+#include <algorithm>
+#include <vector>
+
+#include "core.hpp"
+#include "path.hpp"
+
+///	Range classes of the towers
+enum eRange
+{
+	kShortRange,
+	kMediumRange,
+	kLongRange,
+	kRangeCount
+};
+
+///	Radius of each range class, in pixels
+const size_t kRangeRadius[kRangeCount] = { 32, 48, 80 };
+
+///	A part of a lane within range of a spot: the whole positions from begin to end, both included
+struct coverage_interval
+{
+	const path *lane;
+	size_t begin;
+	size_t end;
+
+	bool operator<( const coverage_interval &o ) const { return lane<o.lane || (lane==o.lane && begin<o.begin); }
+};
+
+///	Everything a spot covers at a given range, sorted by lane then position
+///	Spots and lanes do not move, so this is computed once, with the definitions
+class coverage
+{
+	std::vector<coverage_interval> intervals_;
+
+public:
+	///	Adds the parts of the lane (given by its pixels) within radius of the centre
+	void add( const path &lane, const std::vector<point> &pixels, const point &centre, size_t radius )
+	{
+		auto r2 = radius*radius;
+		bool inside = false;
+		for (size_t i=0;i!=pixels.size();i++)
+		{
+			auto dx = (long)pixels[i].x-(long)centre.x;
+			auto dy = (long)pixels[i].y-(long)centre.y;
+			if ((size_t)(dx*dx+dy*dy)<=r2)
+			{
+				if (!inside)
+					intervals_.push_back( { &lane, i, i } );
+				intervals_.back().end = i;
+				inside = true;
+			}
+			else
+				inside = false;
+		}
+		std::sort( intervals_.begin(), intervals_.end() );
+	}
+
+	void clear() { intervals_.clear(); }
+
+	bool empty() const { return intervals_.empty(); }
+
+	const std::vector<coverage_interval> &intervals() const { return intervals_; }
+
+	///	If a walker at that position on that lane is covered
+	bool contains( const path *lane, scalar position ) const
+	{
+		if (position<0)
+			return false;
+		coverage_interval key{ lane, (size_t)std::floor( (double)position ), 0 };
+		auto i = std::upper_bound( intervals_.begin(), intervals_.end(), key );
+		if (i==intervals_.begin())
+			return false;
+		--i;
+		return i->lane==lane && key.begin<=i->end;
+	}
+};
+
+#endif
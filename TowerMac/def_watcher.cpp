@@ -0,0 +1,151 @@
+//
+//  def_watcher.cpp
+//  TowerMac
+//
+
+#include "def_watcher.hpp"
+
+#include <cstring>
+#include <exception>
+
+#include "logger.hpp"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <sys/stat.h>
+#include <chrono>
+#include <map>
+#endif
+
+static const char *kRestartFiles[] = { "spots.def", "groups.def", "towers.def", "powers.def" };
+
+///	The part of the definitions a file holds, 0 if it is not reloaded
+static unsigned part_of( const char *name )
+{
+	if (!strcmp( name, "lanes.def" ))
+		return def_update::kLanes;
+	if (!strcmp( name, "mobs.def" ))
+		return def_update::kMobs;
+	if (!strcmp( name, "waves.def" ))
+		return def_update::kWaves;
+	for (auto f:kRestartFiles)
+		if (!strcmp( name, f ))
+			logger::info( logger::kDefinitions, "changed, restart to use it", "file", name );
+	return 0;
+}
+
+void def_watcher::reload( unsigned parts )
+{
+	try
+	{
+		auto update = def_update::load( parts, directory_ );
+		std::lock_guard<std::mutex> guard( mutex_ );
+		if (pending_)
+			pending_->merge( std::move( *update ) );
+		else
+			pending_ = std::move( update );
+	}
+	catch (const char *e)
+	{
+		logger::error( logger::kDefinitions, "definitions not reloaded", "reason", e );
+	}
+	catch (const std::exception &e)
+	{
+		logger::error( logger::kDefinitions, "definitions not reloaded", "reason", e.what() );
+	}
+	catch (...)
+	{
+		logger::error( logger::kDefinitions, "definitions not reloaded", "reason", "unknown error" );
+	}
+}
+
+#ifdef __linux__
+
+void def_watcher::run()
+{
+	int fd = inotify_init1( IN_NONBLOCK|IN_CLOEXEC );
+	if (fd<0 || inotify_add_watch( fd, directory_.c_str(), IN_CLOSE_WRITE|IN_MOVED_TO )<0)
+	{
+		logger::warning( logger::kDefinitions, "cannot watch, definitions will not be reloaded", "directory", directory_ );
+		if (fd>=0)
+			close( fd );
+		return;
+	}
+
+	unsigned parts = 0;		///	Changed, waiting for the files to settle
+	alignas(inotify_event) char buffer[4096];
+	while (!quit_)
+	{
+		pollfd p{ fd, POLLIN, 0 };
+		auto ready = poll( &p, 1, parts?kSettleMs:kPollMs );
+		if (ready>0)
+		{
+			ssize_t length;
+			while ((length=read( fd, buffer, sizeof(buffer) ))>0)
+				for (char *e=buffer;e<buffer+length;e+=sizeof(inotify_event)+((inotify_event *)e)->len)
+				{
+					auto event = (inotify_event *)e;
+					if (event->len)
+						parts |= part_of( event->name );
+				}
+		}
+		else if (ready==0 && parts)
+		{
+			reload( parts );
+			parts = 0;
+		}
+	}
+
+	close( fd );
+}
+
+#else
+
+	//	No inotify: compares the modification dates and sizes of the files
+	//	(dates are in seconds, the size catches most edits made within the same second)
+void def_watcher::run()
+{
+	const char *files[] = { "lanes.def", "mobs.def", "waves.def", "spots.def", "groups.def", "towers.def", "powers.def" };
+
+	auto modified = [&]( const char *name )
+	{
+		struct stat st;
+		if (stat( (directory_+"/"+name).c_str(), &st )<0)
+			return std::make_pair( (time_t)0, (off_t)0 );
+		return std::make_pair( st.st_mtime, st.st_size );
+	};
+
+	std::map<std::string,std::pair<time_t,off_t>> dates;
+	for (auto f:files)
+		dates[f] = modified( f );
+
+	unsigned parts = 0;		///	Changed, waiting for the files to settle
+	while (!quit_)
+	{
+		int ms = parts?kSettleMs:kPollMs;
+		std::this_thread::sleep_for( std::chrono::milliseconds( ms ) );
+
+		bool changed = false;
+		for (auto f:files)
+		{
+			auto date = modified( f );
+			if (date!=dates[f])
+			{
+				dates[f] = date;
+				parts |= part_of( f );
+				changed = true;
+			}
+		}
+
+		if (!changed && parts)
+		{
+			reload( parts );
+			parts = 0;
+		}
+	}
+}
+
+#endif
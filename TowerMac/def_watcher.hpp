@@ -0,0 +1,54 @@
+//
+//  def_watcher.hpp
+//  TowerMac
+//
+
+#ifndef DEF_WATCHER_INCLUDED__
+#define DEF_WATCHER_INCLUDED__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "game_def.hpp"
+
+///	Watches the definition files, and parses the ones that change on a background thread
+///	The main thread takes the result between waves, and applies it to game_def::spec
+///	Lanes, mobs and waves are reloaded. Spots and groups are referenced by the saved games, and need a restart
+class def_watcher
+{
+	static const int kSettleMs = 50;		///	Editors write in several steps: waits for them to be done
+	static const int kPollMs = 100;			///	Also how long the destructor may wait
+
+	std::string directory_;
+
+	std::mutex mutex_;
+	std::unique_ptr<def_update> pending_;	///	Parsed, not yet taken by the main thread
+
+	std::atomic<bool> quit_{ false };
+	std::thread thread_;
+
+	void run();
+	void reload( unsigned parts );
+
+public:
+	explicit def_watcher( const std::string &directory ) : directory_{ directory }, thread_{ [this]{ run(); } } {}
+	def_watcher( const def_watcher & ) = delete;
+
+	~def_watcher()
+	{
+		quit_ = true;
+		thread_.join();
+	}
+
+	///	The definitions that changed since the last call, or nullptr
+	std::unique_ptr<def_update> take()
+	{
+		std::lock_guard<std::mutex> guard( mutex_ );
+		return std::move( pending_ );
+	}
+};
+
+#endif
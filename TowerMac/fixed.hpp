@@ -0,0 +1,94 @@
+//
+//  fixed.hpp
+//  TowerMac
+//
+
+#ifndef FIXED_INCLUDED__
+#define FIXED_INCLUDED__
+
+#include <cstdint>
+#include <cstddef>
+
+///	Integer square root of a 64 bits value (floor)
+///	Bit by bit, only shifts and adds, so it is cheap on a 68030 and exact everywhere
+inline uint64_t isqrt( uint64_t v )
+{
+	uint64_t res = 0;
+	uint64_t bit = (uint64_t)1<<62;
+	while (bit>v)
+		bit >>= 2;
+	while (bit)
+	{
+		if (v>=res+bit)
+		{
+			v -= res+bit;
+			res = (res>>1)+bit;
+		}
+		else
+			res >>= 1;
+		bit >>= 2;
+	}
+	return res;
+}
+
+///	A fixed point number, with SCALE bits of decimals, stored in 32 bits
+///	Products and quotients go through 64 bits, so they do not overflow as long as the result fits
+///	Scaling up multiplies by kOne: shifting a negative value left is undefined
+template <int SCALE> class fixed
+{	int32_t value_;
+	static fixed make_fixed( int32_t value ) { fixed v{0}; v.value_ = value; return v; }
+public:
+	static const int32_t kOne = 1<<SCALE;
+
+	fixed() : value_{0} {}
+	fixed( int v ) : value_{ v*kOne } {}
+	fixed( size_t v ) : value_{ ((int32_t)v)*kOne } {}
+	explicit fixed( double v ) : value_{ (int32_t)(v*kOne+(v<0?-0.5:0.5)) } {}
+	int int_value() const { return (value_+(1<<(SCALE-1)))>>SCALE; }
+	size_t size_t_value() const { return (size_t)int_value(); }
+
+	static fixed from_raw( int32_t value ) { return make_fixed( value ); }
+	int32_t raw() const { return value_; }
+
+	explicit operator int() const { return value_>>SCALE; }
+	explicit operator size_t() const { return (size_t)(value_>>SCALE); }
+	explicit operator double() const { return (double)value_/kOne; }
+	explicit operator float() const { return (float)value_/kOne; }
+
+	fixed operator+( const fixed<SCALE> &other ) const { return make_fixed( value_+other.value_ ); }
+	fixed operator-( const fixed<SCALE> &other ) const { return make_fixed( value_-other.value_ ); }
+	fixed operator-() const { return make_fixed( -value_ ); }
+	fixed operator+( size_t value ) const { return make_fixed( value_+((int32_t)value)*kOne ); }
+	fixed operator+( int value ) const { return make_fixed( value_+value*kOne ); }
+	fixed operator/( int div ) const { return make_fixed( value_/div ); }
+	fixed operator*( size_t value ) const { return make_fixed( value_*value ); }
+	fixed operator*( const fixed<SCALE> &other ) const { return make_fixed( (int32_t)(((int64_t)value_*other.value_)>>SCALE) ); }
+	fixed operator/( const fixed<SCALE> &other ) const { return make_fixed( (int32_t)((int64_t)value_*kOne/other.value_) ); }
+
+	fixed &operator+=( const fixed<SCALE> &other ) { value_ += other.value_; return *this; }
+	fixed &operator-=( const fixed<SCALE> &other ) { value_ -= other.value_; return *this; }
+
+	bool operator<( const fixed<SCALE> &other ) const { return value_<other.value_; }
+	bool operator>( const fixed<SCALE> &other ) const { return value_>other.value_; }
+	bool operator<=( const fixed<SCALE> &other ) const { return value_<=other.value_; }
+	bool operator>=( const fixed<SCALE> &other ) const { return value_>=other.value_; }
+	bool operator==( const fixed<SCALE> &other ) const { return value_==other.value_; }
+	bool operator!=( const fixed<SCALE> &other ) const { return value_!=other.value_; }
+};
+
+template <int SCALE> fixed<SCALE> sqrt( const fixed<SCALE> &v )
+{
+	if (v.raw()<=0)
+		return fixed<SCALE>{};
+	return fixed<SCALE>::from_raw( (int32_t)isqrt( ((uint64_t)v.raw())<<SCALE ) );
+}
+
+template <int SCALE> fixed<SCALE> abs( const fixed<SCALE> &v )
+{
+	return v.raw()<0?-v:v;
+}
+
+///	The 16.16 fixed point used by the simulation when built with TM_SCALAR_FIXED
+typedef fixed<16> fixed16;
+
+#endif
@@ -0,0 +1,213 @@
+//
+//  flow_field.cpp
+//  TowerMac
+//
+
+#include "flow_field.hpp"
+
+#include <algorithm>
+
+flow_field::flow_field( const point &origin, size_t width, size_t height ) :
+	origin_{ origin },
+	width_{ width },
+	height_{ height },
+	stride_{ width+2 },
+	offsets_{ (long)stride_, -1, -(long)stride_, 1 },
+	distance_( (width+2)*(height+2), kUnreachable ),
+	direction_( (width+2)*(height+2), kNone ),
+	blocked_( (width+2)*(height+2), 1 ),
+	goal_( (width+2)*(height+2), 0 )
+{
+	for (size_t y=0;y!=height;y++)
+		std::fill_n( blocked_.begin()+index( 0, y ), width, 0 );
+	queue_.reserve( width*height );
+}
+
+	//	The direction from a neighbour back to the cell
+static int opposite( int direction ) { return (direction+2)%4; }
+
+uint8_t flow_field::best_direction( size_t i ) const
+{
+	if (blocked_[i] || distance_[i]==0 || distance_[i]==kUnreachable)
+		return kNone;
+	for (int d=0;d!=kNone;d++)
+		if (distance_[i+offsets_[d]]==distance_[i]-1)
+			return d;
+	return kNone;
+}
+
+template <typename F> void flow_field::for_each( const rect &r, F f )
+{
+	auto x0 = std::max( r.o.x, origin_.x )-origin_.x;
+	auto y0 = std::max( r.o.y, origin_.y )-origin_.y;
+	auto x1 = std::min( r.o.x+r.s.w, origin_.x+width_ );
+	auto y1 = std::min( r.o.y+r.s.h, origin_.y+height_ );
+	if (x1<=origin_.x || y1<=origin_.y)
+		return;
+	x1 -= origin_.x;
+	y1 -= origin_.y;
+	for (auto y=y0;y<y1;y++)
+		for (auto x=x0;x<x1;x++)
+			f( index( x, y ) );
+}
+
+void flow_field::set_goal( const rect &r )
+{
+	std::fill( goal_.begin(), goal_.end(), 0 );
+	for_each( r, [&]( size_t i ) { goal_[i] = 1; } );
+}
+
+void flow_field::compute()
+{
+	std::fill( distance_.begin(), distance_.end(), kUnreachable );
+
+	queue_.clear();
+	for (size_t i=0;i!=goal_.size();i++)
+		if (goal_[i] && !blocked_[i])
+		{
+			distance_[i] = 0;
+			queue_.push_back( (uint32_t)i );
+		}
+
+	for (size_t q=0;q!=queue_.size();q++)
+	{
+		auto c = queue_[q];
+		auto d = distance_[c]+1;
+		for (auto o:offsets_)
+		{
+			auto n = c+o;
+			if (!blocked_[n] && distance_[n]==kUnreachable)
+			{
+				distance_[n] = d;
+				queue_.push_back( (uint32_t)n );
+			}
+		}
+	}
+
+	for (size_t y=0;y!=height_;y++)
+		for (auto i=index( 0, y );i!=index( width_, y );i++)
+			direction_[i] = best_direction( i );
+	changed_.clear();
+}
+
+	//	All steps cost 1: the BFS queue is always sorted, so merging it with the sorted seeds
+	//	visits the cells nearest first, like Dijkstra without a heap
+void flow_field::relax()
+{
+	std::sort( seeds_.begin(), seeds_.end() );
+	queue_.clear();
+	size_t s = 0;
+	size_t q = 0;
+	while (s!=seeds_.size() || q!=queue_.size())
+	{
+		uint32_t c;
+		if (q==queue_.size() || (s!=seeds_.size() && seeds_[s].first<=distance_[queue_[q]]))
+		{
+			auto [d,seed] = seeds_[s++];
+			if (d!=distance_[seed])
+				continue;		//	Lowered since
+			c = seed;
+		}
+		else
+			c = queue_[q++];
+
+		auto d = distance_[c]+1;
+		for (auto o:offsets_)
+		{
+			auto n = c+o;
+			if (!blocked_[n] && d<distance_[n])
+			{
+				distance_[n] = d;
+				queue_.push_back( (uint32_t)n );
+				changed_.push_back( (uint32_t)n );
+			}
+		}
+	}
+}
+
+void flow_field::update_directions()
+{
+	for (auto c:changed_)
+	{
+		direction_[c] = best_direction( c );
+		for (auto o:offsets_)
+			direction_[c+o] = best_direction( c+o );
+	}
+}
+
+	//	Distances can only grow. The cells whose way went through the new obstacles are
+	//	invalidated, then get their distance again from the valid cells around them
+void flow_field::block( const rect &r )
+{
+	changed_.clear();
+	queue_.clear();
+	for_each( r, [&]( size_t i ) {
+		if (blocked_[i]++==0 && distance_[i]!=kUnreachable)
+		{
+			distance_[i] = kUnreachable;
+			queue_.push_back( (uint32_t)i );
+		}
+	} );
+
+		//	Everything downstream of the obstacle, following the directions backwards
+	for (size_t q=0;q!=queue_.size();q++)
+	{
+		auto c = queue_[q];
+		for (int dir=0;dir!=kNone;dir++)
+		{
+			auto n = c+offsets_[dir];
+			if (!blocked_[n] && distance_[n]!=kUnreachable && direction_[n]==opposite( dir ))
+			{
+				distance_[n] = kUnreachable;
+				queue_.push_back( (uint32_t)n );
+			}
+		}
+	}
+	changed_ = queue_;
+
+		//	The invalidated cells next to valid ones start the repair
+		//	(distances are only written once all the seeds are known, so they all come from valid cells)
+	seeds_.clear();
+	for (auto c:queue_)
+	{
+		if (blocked_[c])
+			continue;
+		auto best = kUnreachable;
+		for (auto o:offsets_)
+			best = std::min( best, distance_[c+o] );
+		if (best!=kUnreachable)
+			seeds_.push_back( { best+1, c } );
+	}
+	for (auto [d,c]:seeds_)
+		distance_[c] = d;
+
+	relax();
+	update_directions();
+}
+
+	//	Distances can only shrink: the freed cells take their distance from their neighbours,
+	//	and it spreads from there as long as it is shorter
+void flow_field::unblock( const rect &r )
+{
+	changed_.clear();
+	seeds_.clear();
+	for_each( r, [&]( size_t i ) {
+		assert( blocked_[i] );
+		if (--blocked_[i])
+			return;
+
+		changed_.push_back( (uint32_t)i );
+		auto best = goal_[i]?0:kUnreachable;
+		for (auto o:offsets_)
+			if (best && distance_[i+o]!=kUnreachable)
+				best = std::min( best, distance_[i+o]+1 );
+		if (best!=kUnreachable)
+		{
+			distance_[i] = best;
+			seeds_.push_back( { best, (uint32_t)i } );
+		}
+	} );
+
+	relax();
+	update_directions();
+}
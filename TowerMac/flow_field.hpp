@@ -0,0 +1,108 @@
+//
+//  flow_field.hpp
+//  TowerMac
+//
+
+#ifndef FLOW_FIELD_INCLUDED__
+#define FLOW_FIELD_INCLUDED__
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "core.hpp"
+
+///	For each pixel of the map, the direction to take to reach the goal (the base) by the shortest way
+///	around obstacles (towers, blockers). Mobs steer with a single lookup, whatever their number
+///	The distances are computed with a BFS from the goal. When obstacles are added or removed,
+///	only the cells whose distance changes are computed again
+class flow_field
+{
+public:
+	static const uint32_t kUnreachable = UINT32_MAX;
+
+	///	Directions, with the same values as the path rotations
+	enum eDirection
+	{
+		kDown = 0,
+		kLeft,
+		kUp,
+		kRight,
+		kNone		///	Goal, obstacle, or no way to the goal
+	};
+
+private:
+	point origin_;		///	Screen coordinates of the first cell
+	size_t width_;
+	size_t height_;
+
+		//	The cells are surrounded by a border of blocked cells, so neighbours are always in the arrays
+	size_t stride_;			///	width_+2
+	long offsets_[4];		///	To the neighbour in each direction
+
+	std::vector<uint32_t> distance_;	///	Steps to the goal
+	std::vector<uint8_t> direction_;	///	eDirection
+	std::vector<uint8_t> blocked_;		///	Number of obstacles on the cell
+	std::vector<uint8_t> goal_;
+
+		//	Work lists, kept between updates
+	std::vector<uint32_t> queue_;							///	BFS of compute(), invalidated cells in block()
+	std::vector<std::pair<uint32_t,uint32_t>> seeds_;		///	(distance, cell) where relax() starts
+	std::vector<uint32_t> changed_;							///	Cells whose distance changed in the last update
+
+	size_t index( size_t x, size_t y ) const { return (y+1)*stride_+x+1; }
+
+	///	The first direction that leads to a cell closer to the goal
+	uint8_t best_direction( size_t i ) const;
+
+	///	Lowers distances around the seeds (which already have theirs), nearest first
+	void relax();
+
+	///	Recomputes the directions of the changed cells and of their neighbours
+	void update_directions();
+
+	///	Calls f on each cell index of r, clipped to the field
+	template <typename F> void for_each( const rect &r, F f );
+
+public:
+	flow_field( const point &origin, size_t width, size_t height );
+
+	size_t width() const { return width_; }
+	size_t height() const { return height_; }
+
+	bool contains( const point &p ) const { return p.x>=origin_.x && p.y>=origin_.y && p.x<origin_.x+width_ && p.y<origin_.y+height_; }
+
+	///	Where the mobs go. Call compute() afterwards
+	void set_goal( const rect &r );
+
+	///	Computes the whole field
+	void compute();
+
+	///	Adds or removes an obstacle, and updates the cells whose way to the goal changed
+	///	Obstacles can overlap: a cell is free once all the obstacles on it are removed
+	void block( const rect &r );
+	void unblock( const rect &r );
+
+	///	Number of cells visited by the last block() or unblock()
+	size_t touched() const { return changed_.size(); }
+
+	uint32_t distance( const point &p ) const { return distance_[index( p.x-origin_.x, p.y-origin_.y )]; }
+	int direction( const point &p ) const { return direction_[index( p.x-origin_.x, p.y-origin_.y )]; }
+	bool is_goal( const point &p ) const { return distance( p )==0; }
+	bool is_reachable( const point &p ) const { return contains( p ) && distance( p )!=kUnreachable; }
+
+	///	The next pixel in that direction
+	static point next( const point &p, int direction )
+	{
+		switch (direction)
+		{
+			case kDown: return { p.x, p.y+1 };
+			case kLeft: return { p.x-1, p.y };
+			case kUp: return { p.x, p.y-1 };
+			case kRight: return { p.x+1, p.y };
+		}
+		return p;
+	}
+};
+
+#endif
@@ -6,6 +6,7 @@
 //
 
 #include "font.hpp"
+#include "logger.hpp"
 
 #include <iostream>
 
@@ -56,7 +57,7 @@ font::font( const std::string &filename )
 	SDL_Surface *s = IMG_Load( filename.c_str() );
 	if (!s)
 	{
-		std::cerr << "Cannot load font [" << filename << "]\n";
+		logger::error( logger::kGraphics, "cannot load font", "file", filename );
 		throw "Cannot load font";
 	}
 	SDL_LockSurface( s );
@@ -71,7 +72,7 @@ font::font( const std::string &filename )
 		while (get_pixel(s,x++,0)!=0)
 			;
 
-		std::clog << c << ":" << x-bx-1 << " ";
+		logger::debug( logger::kGraphics, "glyph", "char", c, "width", x-bx-1 );
 
 		SDL_Surface *sub_surf = SDL_CreateRGBSurface(
 														0,
@@ -100,7 +101,6 @@ font::font( const std::string &filename )
 		p += x-bx;
 	}
 	assert ( x==s->w );
-	std::clog << "\n";
 
 		//	Uppercase letters
 	for (char c='a';c<='z';c++)
@@ -114,9 +114,14 @@ font::font( const std::string &filename )
 	SDL_FreeSurface( s );
 }
 
-void font::draw_letter(point &screen_pointer, char c) const
+void font::draw_letter(point &screen_pointer, char c, bool inverted) const
 {
-    images_[c]->render( screen_pointer );
+	if (!inverted)
+		images_[c]->render( screen_pointer );
+	else if (framebuffer::screen)
+		framebuffer::screen->blit( images_[c]->bits(), (int)screen_pointer.x, (int)screen_pointer.y, framebuffer::kXor );
+	else
+		inverted_[c]->render( screen_pointer );
     screen_pointer.x+=((int)images_[c]->width());
 }
 
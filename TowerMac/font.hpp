@@ -17,27 +17,6 @@
 
 #include <memory>
 
-template <int SCALE> class fixed
-{	int32_t value_;
-	static fixed make_fixed( int32_t value ) { fixed v{0}; v.value_ = value; return v; }
-public:
-	fixed() : value_{0} {}
-	fixed( int v ) : value_{ v<<SCALE } {}
-	fixed( size_t v ) : value_{ ((int32_t)v)<<SCALE } {}
-	int int_value() const { return (value_+(1<<(SCALE-1)))>>SCALE; }
-	size_t size_t_value() const { return (size_t)int_value(); }
-
-	fixed operator+( const fixed<SCALE> &other ) const { return make_fixed( value_+other.value_ ); }
-	fixed operator-( const fixed<SCALE> &other ) const { return make_fixed( value_-other.value_ ); }
-	fixed operator+( size_t value ) const { return make_fixed( value_+(((int32_t)value)<<SCALE) ); }
-	fixed operator+( int value ) const { return make_fixed( value_+(value<<SCALE) ); }
-	fixed operator/( int div ) const { return make_fixed( value_/div ); }
-	fixed operator*( size_t value ) const { return make_fixed( value_*value ); }
-
-	bool operator<( const fixed<SCALE> &other ) const { return value_<other.value_; }
-	bool operator>( const fixed<SCALE> &other ) const { return value_>other.value_; }
-};
-
 typedef fixed<16> fract;
 
 class font
@@ -62,7 +41,7 @@ public:
 	//	Spacing is the number of pixels we should add to all spaces throught the display
 	//	IntraSpacing is the number of pixels we should add to all letters throught the display
 
-	void draw_letter(point &screen_pointer, char c) const;
+	void draw_letter(point &screen_pointer, char c, bool inverted=false) const;
 
 	static bool is_separator( char c ) { return c==' ' || c=='\n'; }
 	static bool is_eol( char c ) { return c=='\n'; }
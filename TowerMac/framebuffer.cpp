@@ -0,0 +1,240 @@
+//
+//  framebuffer.cpp
+//  TowerMac
+//
+
+#include "framebuffer.hpp"
+#include "logger.hpp"
+
+#include <cstdio>
+#include <algorithm>
+
+#include <SDL2/SDL.h>
+
+extern SDL_Renderer *gRenderer;
+
+std::unique_ptr<framebuffer> framebuffer::screen;
+
+bitmap::bitmap( SDL_Surface *s, const SDL_Rect &r ) :
+	width_{ r.w },
+	height_{ r.h },
+	row_words_{ (r.w+15)/16 },
+	bits_( row_words_*r.h ),
+	mask_( row_words_*r.h )
+{
+		//	4x4 ordered dither, so the gray map stays readable
+	static const int kBayer[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+
+	auto src = SDL_ConvertSurfaceFormat( s, SDL_PIXELFORMAT_ARGB8888, 0 );
+	assert( src );
+	SDL_LockSurface( src );
+	for (int y=0;y!=height_;y++)
+	{
+		auto line = (const uint32_t *)((const char *)src->pixels+(r.y+y)*src->pitch)+r.x;
+		for (int x=0;x!=width_;x++)
+		{
+			auto p = line[x];
+			int a = (p>>24)&0xff;
+			int lum = (((p>>16)&0xff)*30+((p>>8)&0xff)*59+(p&0xff)*11)/100;
+			uint16_t bit = 0x8000>>(x&15);
+			auto index = y*row_words_+x/16;
+			if (lum<kBayer[y&3][x&3]*16+8)
+				bits_[index] |= bit;
+			if (a>=128)
+				mask_[index] |= bit;
+			else
+				bits_[index] &= ~bit;
+		}
+	}
+	SDL_UnlockSurface( src );
+	SDL_FreeSurface( src );
+}
+
+framebuffer::~framebuffer()
+{
+	if (texture_)
+		SDL_DestroyTexture( texture_ );
+}
+
+void framebuffer::clear( bool black )
+{
+	std::fill( std::begin(bits_), std::end(bits_), black?0xffff:0 );
+}
+
+void framebuffer::set_pixel( int x, int y, bool black )
+{
+	if (x<0 || y<0 || x>=kWidth || y>=kHeight)
+		return;
+	uint16_t bit = 0x8000>>(x&15);
+	auto &w = bits_[y*kRowWords+x/16];
+	if (black)
+		w |= bit;
+	else
+		w &= ~bit;
+}
+
+void framebuffer::fill_rect( int x, int y, int w, int h, bool black )
+{
+	int x0 = std::max( x, 0 );
+	int y0 = std::max( y, 0 );
+	int x1 = std::min( x+w, kWidth );
+	int y1 = std::min( y+h, kHeight );
+	if (x0>=x1 || y0>=y1)
+		return;
+
+	int w0 = x0>>4;
+	int w1 = (x1-1)>>4;
+	uint16_t left = 0xffff>>(x0&15);
+	uint16_t right = 0xffff<<(15-((x1-1)&15));
+	if (w0==w1)
+		left = right = left&right;
+
+	auto apply = [black]( uint16_t &word, uint16_t mask ) { if (black) word |= mask; else word &= ~mask; };
+
+	for (int row=y0;row!=y1;row++)
+	{
+		auto p = bits_+row*kRowWords;
+		apply( p[w0], left );
+		if (w0!=w1)
+		{
+			std::fill( p+w0+1, p+w1, black?0xffff:0 );
+			apply( p[w1], right );
+		}
+	}
+}
+
+void framebuffer::frame_rect( int x, int y, int w, int h, bool black )
+{
+	fill_rect( x, y, w, 1, black );
+	fill_rect( x, y+h-1, w, 1, black );
+	fill_rect( x, y+1, 1, h-2, black );
+	fill_rect( x+w-1, y+1, 1, h-2, black );
+}
+
+///	Each source word is shifted into two destination words
+///	The source row is read one extra word, to flush the bits shifted out of its last word
+void framebuffer::blit( const bitmap &b, int x, int y, eMode mode )
+{
+	int word = x>>4;				//	Arithmetic shift, so negative coordinates round down
+	int shift = x-word*16;
+
+	int first_row = std::max( 0, -y );
+	int last_row = std::min( b.height_, kHeight-y );
+
+	for (int row=first_row;row<last_row;row++)
+	{
+		auto src = b.bits_.data()+row*b.row_words_;
+		auto msk = b.mask_.data()+row*b.row_words_;
+		auto dst = bits_+(y+row)*kRowWords;
+
+		uint32_t bits = 0;
+		uint32_t mask = 0;
+		for (int i=0;i<=b.row_words_;i++)
+		{
+			bits = (bits<<16)|(i<b.row_words_?src[i]:0);
+			mask = (mask<<16)|(i<b.row_words_?msk[i]:0);
+			int dx = word+i;
+			if (dx<0 || dx>=kRowWords)
+				continue;
+
+			uint16_t s = (uint16_t)(bits>>shift);
+			uint16_t m = (uint16_t)(mask>>shift);
+			switch (mode)
+			{
+				case kCopy:
+					dst[dx] = (dst[dx]&~m)|(s&m);
+					break;
+				case kOr:
+					dst[dx] |= s&m;
+					break;
+				case kXor:
+					dst[dx] ^= s&m;
+					break;
+			}
+		}
+	}
+}
+
+bitmap framebuffer::grab( int x, int y, int w, int h ) const
+{
+	bitmap b;
+	b.width_ = w;
+	b.height_ = h;
+	b.row_words_ = (w+15)/16;
+	b.bits_.resize( b.row_words_*h );
+	b.mask_.resize( b.row_words_*h );
+	for (int row=0;row!=h;row++)
+		for (int col=0;col!=w;col++)
+		{
+			uint16_t bit = 0x8000>>(col&15);
+			auto index = row*b.row_words_+col/16;
+			b.mask_[index] |= bit;
+			int sx = x+col;
+			int sy = y+row;
+			if (sx>=0 && sy>=0 && sx<kWidth && sy<kHeight && (bits_[sy*kRowWords+sx/16]&(0x8000>>(sx&15))))
+				b.bits_[index] |= bit;
+		}
+	return b;
+}
+
+bool framebuffer::save_pbm( const std::string &filename ) const
+{
+	auto f = fopen( filename.c_str(), "wb" );
+	if (!f)
+		return false;
+	fprintf( f, "P4\n%d %d\n", kWidth, kHeight );
+	for (auto w:bits_)
+	{
+		fputc( w>>8, f );
+		fputc( w&0xff, f );
+	}
+	fclose( f );
+	return true;
+}
+
+void framebuffer::begin_frame()
+{
+	frame_start_ = SDL_GetPerformanceCounter();
+}
+
+void framebuffer::end_frame()
+{
+	auto duration = SDL_GetPerformanceCounter()-frame_start_;
+	frame_total_ += duration;
+	frame_max_ = std::max( frame_max_, duration );
+	frame_count_++;
+
+	if (frame_count_==256)
+	{
+		auto us = 1000000.0/SDL_GetPerformanceFrequency();
+		logger::info( logger::kPerf, "1-bit frames", "frames", frame_count_, "mean_us", frame_total_*us/frame_count_, "max_us", frame_max_*us );
+		frame_total_ = frame_max_ = 0;
+		frame_count_ = 0;
+	}
+
+	if (!dump_directory_.empty())
+	{
+		char name[32];
+		snprintf( name, sizeof(name), "/frame-%06zu.pbm", dump_count_++ );
+		save_pbm( dump_directory_+name );
+	}
+}
+
+void framebuffer::present()
+{
+	if (!texture_)
+	{
+		texture_ = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, kWidth, kHeight );
+		pixels_.resize( kWidth*kHeight );
+	}
+
+	auto p = pixels_.data();
+	for (auto w:bits_)
+		for (int bit=15;bit>=0;bit--)
+			*p++ = (w>>bit)&1?0xff000000:0xffffffff;
+
+	SDL_Rect r{ 0, 0, kWidth, kHeight };
+	SDL_UpdateTexture( texture_, nullptr, pixels_.data(), kWidth*4 );
+	SDL_RenderCopy( gRenderer, texture_, nullptr, &r );
+	SDL_RenderPresent( gRenderer );
+}
@@ -0,0 +1,104 @@
+//
+//  framebuffer.hpp
+//  TowerMac
+//
+
+#ifndef FRAMEBUFFER_INCLUDED__
+#define FRAMEBUFFER_INCLUDED__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core.hpp"
+
+struct SDL_Surface;
+struct SDL_Rect;
+struct SDL_Texture;
+
+///	A 1-bit image and its mask, packed in 16 bits words, leftmost pixel in the high bit
+class bitmap
+{
+	int width_ = 0;
+	int height_ = 0;
+	int row_words_ = 0;
+	std::vector<uint16_t> bits_;	///	1 is black
+	std::vector<uint16_t> mask_;	///	1 is opaque
+
+	friend class framebuffer;
+
+public:
+	bitmap() {}
+
+	///	Converts a part of a surface, gray levels are dithered
+	bitmap( SDL_Surface *s, const SDL_Rect &r );
+
+	int width() const { return width_; }
+	int height() const { return height_; }
+	bool empty() const { return bits_.empty(); }
+};
+
+///	The software 1-bit backend: everything is drawn in a packed 512x342 frame buffer, as on the compact Macs
+///	It is only used when selected at startup, in which case framebuffer::screen is set
+///	The SDL window then only displays a copy of the frame buffer
+class framebuffer
+{
+public:
+	static const int kWidth = SCREEN_WIDTH;
+	static const int kHeight = SCREEN_HEIGHT;
+	static const int kRowWords = kWidth/16;
+
+	enum eMode
+	{
+		kCopy,		///	Opaque pixels of the source replace the destination
+		kOr,		///	Black pixels of the source are added
+		kXor		///	Black pixels of the source invert the destination (inverted text)
+	};
+
+private:
+	uint16_t bits_[kRowWords*kHeight];	///	1 is black
+
+	SDL_Texture *texture_ = nullptr;	///	To display the frame buffer in the SDL window
+	std::vector<uint32_t> pixels_;
+
+		//	Per frame timing
+	uint64_t frame_start_ = 0;
+	uint64_t frame_total_ = 0;
+	uint64_t frame_max_ = 0;
+	size_t frame_count_ = 0;
+
+	std::string dump_directory_;		///	If not empty, every frame is saved there as a PBM
+	size_t dump_count_ = 0;
+
+public:
+	///	The 1-bit screen, if this backend was selected
+	static std::unique_ptr<framebuffer> screen;
+
+	framebuffer() { clear(); }
+	~framebuffer();
+
+	void clear( bool black=false );
+	void set_pixel( int x, int y, bool black );
+	void fill_rect( int x, int y, int w, int h, bool black );
+	void frame_rect( int x, int y, int w, int h, bool black );
+	void blit( const bitmap &b, int x, int y, eMode mode=kCopy );
+
+	///	Copies a part of the screen in an opaque bitmap
+	bitmap grab( int x, int y, int w, int h ) const;
+
+	static size_t size_in_bytes() { return sizeof(bits_); }
+
+	///	Writes the frame buffer as a binary PBM, which happens to be the same bit layout
+	bool save_pbm( const std::string &filename ) const;
+	void set_dump_directory( const std::string &directory ) { dump_directory_ = directory; }
+
+	///	Frame bracketing: measures the drawing time, and dumps the frame if asked to
+	void begin_frame();
+	void end_frame();
+
+	///	Copies the frame buffer to the SDL window
+	void present();
+};
+
+#endif
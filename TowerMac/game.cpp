@@ -9,7 +9,10 @@
 
 #include <fstream>
 
-std::array<std::string,(size_t)item::eItemClass::kItemClassCount> item::item_class_names = { "tower", "cooldown" };
+std::array<std::string,(size_t)item::eItemClass::kItemClassCount> item::item_class_names = { "tower", "cooldown", "effect" };
+
+const char *effect_item::names[kEffectCount] = { "slow", "poison", "stun" };
+const uint32_t effect_item::modifiers[kEffectCount] = { kSlowingModifier, kPoisonModifier, kStunningModifier };
 
 std::unique_ptr<item> item::load( std::istream &s )
 {
@@ -24,6 +27,8 @@ std::unique_ptr<item> item::load( std::istream &s )
 					return std::make_unique<tower_item>( s );
 				case eItemClass::kCooldownItem:
 					return std::make_unique<cooldown_item>( s );
+				case eItemClass::kEffectItem:
+					return std::make_unique<effect_item>( s );
 				case eItemClass::kItemClassCount:
 					throw "Unknow item in savefile";
 			}
@@ -31,6 +36,29 @@ std::unique_ptr<item> item::load( std::istream &s )
 	throw "Unknow item in savefile";
 }
 
+void loadout::add( const item *i )
+{
+		//	New towers get all the current modifiers
+	auto count = towers_.size();
+	i->create( *this );
+	if (towers_.size()!=count)
+	{
+		for (auto t=towers_.begin()+count;t!=towers_.end();t++)
+			apply_modifiers( *t );
+		return;
+	}
+
+		//	New modifier: apply on top of the others if it comes last, else recompute the towers
+	auto pos = std::upper_bound( std::begin(modifiers_), std::end(modifiers_), i, item::compare_ptr );
+	bool last = pos==std::end(modifiers_);
+	modifiers_.insert( pos, i );
+	for (auto &t:towers_)
+		if (last)
+			i->modify( t.stats );
+		else
+			apply_modifiers( t );
+}
+
 std::unique_ptr<game> game::load( const std::string &filename )
 {
 	auto g = std::make_unique<game>();
@@ -17,6 +17,8 @@
 #include "bullet.hpp"
 #include <iostream>
 
+class loadout;
+
 ///	Anything that changes a simulation (towerplacement, powerup, etc)
 class item
 {
@@ -25,6 +27,7 @@ protected:
 	{
 		kTowerItem,
 		kCooldownItem,
+		kEffectItem,
 		kItemClassCount
 	};
 	virtual eItemClass item_class() const = 0;
@@ -38,9 +41,13 @@ public:
 	item( size_t priority=0 ) : priority_{ priority } {}
 	virtual ~item() {}
 	
-	///	Applies to a simulation to set it up
-	virtual void apply( simulation &simulation ) const = 0;
+	///	Adds the towers created by this item to the loadout
+	virtual void create( loadout &loadout ) const {}
+
+	///	Modifies the stats of a single tower
+	virtual void modify( tower_stats &stats ) const {}
 
+	size_t priority() const { return priority_; }
 	static bool compare_ptr( const item* a, const item* b) { return a->priority_<b->priority_; }
 	
 	static std::unique_ptr<item> load( std::istream &s );
@@ -48,6 +55,53 @@ public:
 	void save( std::ostream &s ) const { s << item_class_names[(size_t)item_class()] << " "; do_save( s ); }
 };
 
+///	The towers of the next wave, compiled from all the items of a game
+///	Each item is compiled once, when added. Starting a wave only creates the towers from the table
+class loadout
+{
+public:
+	struct tower_def
+	{
+		const spot *place;
+		tower_stats stats;
+	};
+
+private:
+	std::vector<tower_def> towers_;
+	std::vector<const item *> modifiers_;	///	Items that modify towers, by priority
+
+	void apply_modifiers( tower_def &t ) const
+	{
+		t.stats = {};
+		for (auto m:modifiers_)
+			m->modify( t.stats );
+	}
+
+public:
+	///	Called by the items that create towers
+	void add_tower( const spot *spot ) { towers_.push_back( { spot } ); }
+
+	///	Compiles an item into the loadout
+	void add( const item *i );
+
+	const std::vector<tower_def> &towers() const { return towers_; }
+
+	///	The stats a tower on that spot would get from the items
+	tower_stats stats_for( const spot *spot ) const
+	{
+		tower_def t{ spot };
+		apply_modifiers( t );
+		return t.stats;
+	}
+
+	///	Creates the towers in a simulation
+	void instantiate( simulation &simulation ) const
+	{
+		for (auto &t:towers_)
+			simulation.create_tower( t.place->location, t.stats, &game_def::spec.get_coverage( t.place, t.stats.range ) );
+	}
+};
+
 class tower_item : public item
 {
 	const spot *spot_;	//	#### Maybe have a 'spotted' item superclass
@@ -67,9 +121,9 @@ public:
 		spot_ = game_def::spec.spot_by_name( spot );
 	}
 
-	virtual void apply( simulation &simulation ) const
+	virtual void create( loadout &loadout ) const
 	{
-		simulation.create_tower( spot_->location );
+		loadout.add_tower( spot_ );
 	}
 };
 
@@ -82,12 +136,47 @@ public:
 	cooldown_item() : item{ 1 } {}
 	cooldown_item( std::istream &s ) : item(1) {}
 
-	virtual void apply( simulation &simulation ) const
+	virtual void modify( tower_stats &stats ) const
 	{
-		for (auto &t:simulation.all_towers())
-		{
-			t->set_cooldown( t->cooldown()/2 );
-		}
+		stats.cooldown /= 2;
+	}
+};
+
+///	Towers shoot bullets that leave a status effect on the mobs they hit
+class effect_item : public item
+{
+	uint32_t modifier_;		///	One of the eModifier effect bits
+
+	static const char *names[kEffectCount];
+	static const uint32_t modifiers[kEffectCount];
+
+	virtual eItemClass item_class() const { return eItemClass::kEffectItem; };
+
+	virtual void do_save( std::ostream &s ) const
+	{
+		for (int i=0;i!=kEffectCount;i++)
+			if (modifiers[i]==modifier_)
+				s << names[i] << " ";
+	}
+
+public:
+	effect_item( eEffect effect ) : item{ 1 }, modifier_{ modifiers[effect] } {}
+	effect_item( std::istream &s ) : item{ 1 }
+	{
+		std::string name;
+		s >> name;
+		for (int i=0;i!=kEffectCount;i++)
+			if (name==names[i])
+			{
+				modifier_ = modifiers[i];
+				return;
+			}
+		throw "Unknown effect in savefile";
+	}
+
+	virtual void modify( tower_stats &stats ) const
+	{
+		stats.modifiers |= modifier_;
 	}
 };
 
@@ -100,6 +189,9 @@ class game
 
 	///	The items are what recreates the game state
 	std::vector<std::unique_ptr<item>> items_;
+
+	///	The items, compiled
+	loadout loadout_;
 public:
 	static std::unique_ptr<game> load( const std::string &filename );
 	void save( const std::string &filename );
@@ -111,7 +203,11 @@ public:
 		open_spots_.erase(std::remove(std::begin(open_spots_), std::end(open_spots_), spot));
 	}
 
-	void add_item( std::unique_ptr<item> item ) { items_.emplace_back( std::move( item ) ); }
+	void add_item( std::unique_ptr<item> item )
+	{
+		items_.emplace_back( std::move( item ) );
+		loadout_.add( items_.back().get() );
+	}
 	
 	const std::vector<const spot *> &open_spots() const { return open_spots_; }
 	const std::vector<const item *> items() const
@@ -123,11 +219,11 @@ public:
 		return res;
 	}
 	
+	const loadout &get_loadout() const { return loadout_; }
+
 	void apply( simulation &simulation )
 	{
-		auto its = items();
-		for (auto &i:its)
-			i->apply( simulation );
+		loadout_.instantiate( simulation );
 	}
 };
 
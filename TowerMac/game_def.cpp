@@ -1,6 +1,10 @@
 #include "game_def.hpp"
+#include "logger.hpp"
 
-const game_def game_def::spec;
+#include <cerrno>
+#include <climits>
+
+game_def game_def::spec;
 
 class resource_def
 {
@@ -53,12 +57,39 @@ public:
 		return !done;
 	}
 	
-	std::string read_name() { next_token(); assert( token_); std::string res{ token_ }; return res; }
-	std::string read_name_opt() { if (*current_=='"') return ""; next_token(); if (!token_) return ""; std::string res{ token_ }; return res; }
-	int read_int() { next_token(); assert( token_); int res = atoi(token_); return res; }
-	size_t read_size_t() { next_token(); assert( token_); size_t res = atoi(token_); return res; }
+	///	Definition files are edited while the game runs: a missing or garbled value throws, it never asserts
+	static long to_long( const char *token )
+	{
+		char *end;
+		errno = 0;
+		long res = strtol( token, &end, 10 );
+		if (end==token || *end || errno)
+			throw "Not a number";
+		return res;
+	}
+	static size_t to_size_t( const char *token )
+	{
+		auto res = to_long( token );
+		if (res<0)
+			throw "Negative number";
+		return res;
+	}
+
+	std::string read_name() { next_token(); if (!token_ || !*token_) throw "Missing value"; std::string res{ token_ }; return res; }
+	std::string read_name_opt() { if (eol() || *current_=='"') return ""; next_token(); if (!token_) return ""; std::string res{ token_ }; return res; }
+	int read_int() { auto res = to_long( read_name().c_str() ); if (res<INT_MIN || res>INT_MAX) throw "Number too large"; return (int)res; }
+	size_t read_size_t() { return to_size_t( read_name().c_str() ); }
 	point read_point() { auto x = read_size_t(); auto y = read_size_t(); return {x,y}; }
-	std::string read_text() { assert( *current_++=='"' ); next_token( "\"" ); assert( token_); std::string res{ token_ }; return res; }
+	std::string read_text()
+	{
+		if (eol() || *current_++!='"')
+			throw "Missing text";
+		next_token( "\"" );
+		if (!current_)
+			throw "Unterminated text";
+		std::string res{ token_ };
+		return res;
+	}
 
 	size_t count_tabs() const { const char *p = current_; while (*p=='\t') p++; return p-current_; }
 	void skip_tabs( size_t tab_count )
@@ -85,7 +116,7 @@ public:
 		auto f = fopen( file.c_str(), "r" );
 		if (!f)
 		{
-			std::cerr << "Cannot open " << file << "\n";
+			logger::error( logger::kDefinitions, "cannot open", "file", file );
 			throw "Cannot load file";
 		}
 		return std::make_unique<resource_def>( f );
@@ -99,10 +130,29 @@ void load_lanes( std::map<std::string,path> &def, const std::string &file )
 	while (f->load_line())
 	{
 		auto name = f->read_name();
-		std::vector<point> p;
+		auto map = point{ kMapX, kMapY };
+		path p{ f->read_point()+map };
 
 		while (!f->eol())
-			p.push_back( f->read_point()+point{ kMapX, kMapY } );
+		{
+			auto token = f->read_name();
+			if (token=="q")
+			{
+				auto control = f->read_point()+map;
+				p.quadratic_to( control, f->read_point()+map );
+			}
+			else if (token=="c")
+			{
+				auto control1 = f->read_point()+map;
+				auto control2 = f->read_point()+map;
+				p.cubic_to( control1, control2, f->read_point()+map );
+			}
+			else
+			{
+				auto x = resource_def::to_size_t( token.c_str() );
+				p.line_to( point{ x, f->read_size_t() }+map );
+			}
+		}
 
 		def.insert( { name, p } );
 	}
@@ -118,7 +168,7 @@ void load_spots( std::map<std::string,spot *> &def, const std::string &file )
 		auto pt = f->read_point();
 		auto description = f->read_text();
 
-		std::cout << "    [" << description << "]\n";
+		logger::debug( logger::kDefinitions, "spot", "key", name, "description", description );
 
 		def.insert( { name, new spot{ name, pt, description } } );
 	}
@@ -215,20 +265,116 @@ game_def::game_def()
 	load_waves( wave_defs_, "assets/defs/waves.def" );
 
 		//  Link definitions
-	for (auto &w:wave_defs_)
+	link( wave_defs_, lane_defs_, mob_defs_, def_update::kLanes|def_update::kMobs );
+	build_coverage();
+}
+
+	//	Towers fire from the spot location, so this is where the ranges are measured from
+void game_def::build_coverage()
+{
+	for (auto &[k,s]:spot_defs_)
+		for (auto &c:coverage_[s])
+			c.clear();
+
+	for (auto &[name,l]:lane_defs_)
+	{
+		auto pixels = l.pixels();
+		for (auto &[key,s]:spot_defs_)
+			for (int r=0;r!=kRangeCount;r++)
+				coverage_[s][r].add( l, pixels, s->location, kRangeRadius[r] );
+	}
+}
+
+void game_def::link( std::vector<wave_def> &waves, std::map<std::string,path> &lanes, std::map<const std::string, mob_def> &mobs, unsigned parts )
+{
+	for (auto &w:waves)
 		for (auto &wl:w.wavelets)
 		{
-			try
+			if (parts&def_update::kLanes)
 			{
-				wl.path_ = &lane_defs_.at(wl.lane_key);
-			}
-			catch (...)
-			{
-				std::cerr << "Failed to link to lane [" << wl.lane_key << "]\n";
-				throw "Bad definition files";
+				auto l = lanes.find( wl.lane_key );
+				if (l==lanes.end())
+				{
+					logger::error( logger::kDefinitions, "failed to link to lane", "lane", wl.lane_key );
+					throw "Bad definition files";
+				}
+				wl.path_ = &l->second;
 			}
-			for (auto &mg:wl.mob_groups)
-				mg.mob_def_ = &mob_defs_.at(mg.mob_key);
+			if (parts&def_update::kMobs)
+				for (auto &mg:wl.mob_groups)
+				{
+					auto m = mobs.find( mg.mob_key );
+					if (m==mobs.end())
+					{
+						logger::error( logger::kDefinitions, "failed to link to mob", "mob", mg.mob_key );
+						throw "Bad definition files";
+					}
+					mg.mob_def_ = &m->second;
+				}
 		}
+}
+
+std::unique_ptr<def_update> def_update::load( unsigned parts, const std::string &directory )
+{
+	auto update = std::make_unique<def_update>();
+	update->parts = parts;
+	if (parts&kLanes)
+		load_lanes( update->lane_defs, directory+"/lanes.def" );
+	if (parts&kMobs)
+		load_mobs( update->mob_defs, directory+"/mobs.def" );
+	if (parts&kWaves)
+		load_waves( update->wave_defs, directory+"/waves.def" );
+	return update;
+}
+
+void def_update::merge( def_update &&newer )
+{
+	if (newer.parts&kLanes)
+		lane_defs = std::move( newer.lane_defs );
+	if (newer.parts&kMobs)
+		mob_defs = std::move( newer.mob_defs );
+	if (newer.parts&kWaves)
+		wave_defs = std::move( newer.wave_defs );
+	parts |= newer.parts;
+}
 
+bool game_def::apply( def_update &&update )
+{
+	auto &lanes = (update.parts&def_update::kLanes)?update.lane_defs:lane_defs_;
+	auto &mobs = (update.parts&def_update::kMobs)?update.mob_defs:mob_defs_;
+	auto &waves = (update.parts&def_update::kWaves)?update.wave_defs:wave_defs_;
+
+		//	New waves link to everything, existing waves only to what changed
+	auto relink = (update.parts&def_update::kWaves)?def_update::kLanes|def_update::kMobs:update.parts;
+
+		//	Check on a copy of the waves, so a bad update leaves the current links intact
+	try
+	{
+		auto check = waves;
+		link( check, lanes, mobs, relink );
+	}
+	catch (const char *e)
+	{
+		logger::error( logger::kDefinitions, "definitions not reloaded", "reason", e );
+		return false;
+	}
+
+	if (update.parts&def_update::kLanes)
+		lane_defs_.swap( update.lane_defs );
+	if (update.parts&def_update::kMobs)
+		mob_defs_.swap( update.mob_defs );
+	if (update.parts&def_update::kWaves)
+		wave_defs_.swap( update.wave_defs );
+	link( wave_defs_, lane_defs_, mob_defs_, relink );
+	if (update.parts&def_update::kLanes)
+		build_coverage();
+
+	logger::info( logger::kDefinitions, "definitions reloaded", "lanes", (update.parts&def_update::kLanes)!=0, "mobs", (update.parts&def_update::kMobs)!=0, "waves", (update.parts&def_update::kWaves)!=0 );
+	return true;
+}
+
+game_def::~game_def()
+{
+	for (auto &[k,v]:spot_defs_)
+		delete v;
 }
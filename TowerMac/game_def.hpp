@@ -1,13 +1,16 @@
 #ifndef GAME_DEF_INCLUDED__
 #define GAME_DEF_INCLUDED__
 
+#include <array>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "core.hpp"
 
 #include "path.hpp"
+#include "coverage.hpp"
 
 /// A mob
 struct mob_def
@@ -53,6 +56,12 @@ struct spot
 	{
 		return distance( p, location )< 16;
 	}
+
+	///	What a tower on the spot covers on screen: the 16x16 square the spot is drawn centered in
+	rect footprint() const
+	{
+		return { { location.x+kMapX-8, location.y+kMapY-8 }, { 16, 16 } };
+	}
 };
 
 struct spot_group
@@ -61,6 +70,29 @@ struct spot_group
 	std::vector<const spot*> spots;
 };
 
+/// Definitions parsed again from the files that changed on disk
+/// Only the parts that changed are present
+struct def_update
+{
+	enum
+	{
+		kLanes = 1,
+		kMobs = 2,
+		kWaves = 4
+	};
+	unsigned parts = 0;
+
+	std::map<std::string,path> lane_defs;
+	std::map<const std::string, mob_def> mob_defs;
+	std::vector<wave_def> wave_defs;
+
+	/// Parses the given parts from the files of a directory (on any thread). Throws if a file cannot be read
+	static std::unique_ptr<def_update> load( unsigned parts, const std::string &directory = "assets/defs" );
+
+	/// Takes the parts of a more recent update
+	void merge( def_update &&newer );
+};
+
 class game_def
 {
 	std::map<std::string,path> lane_defs_;              //  All known lanes
@@ -69,11 +101,27 @@ class game_def
 	std::vector<wave_def> wave_defs_;
 
 	std::map<std::string,spot_group> groups_;
+
+	///	What a tower on each spot covers, for each range class
+	std::map<const spot *,std::array<coverage,kRangeCount>> coverage_;
 	
 	game_def();
+	~game_def();
+
+	/// Links the wavelets to their lanes and their mob groups to their mobs
+	static void link( std::vector<wave_def> &waves, std::map<std::string,path> &lanes, std::map<const std::string, mob_def> &mobs, unsigned parts );
+
+	/// Computes the coverage of every spot on the current lanes
+	void build_coverage();
 
 public:
-	static const game_def spec;
+	/// Only modified by apply(), between waves, on the main thread
+	static game_def spec;
+
+	/// Swaps in the definitions of the update, and links what depends on them
+	/// Nothing must use the current lanes, mobs or waves (no wave in progress)
+	/// If the update does not link, it is rejected, and the current definitions are kept
+	bool apply( def_update &&update );
 
 	const std::vector<wave_def> &wave_defs() const { return wave_defs_; };
 
@@ -91,6 +139,12 @@ public:
 		return spot_defs_.at( key );
 	}
 	
+	/// The parts of the lanes a tower on that spot reaches. Stays at the same address when the lanes are reloaded
+	const coverage &get_coverage( const spot *s, eRange range ) const
+	{
+		return coverage_.at( s )[range];
+	}
+
 	const wave_def &get_wave( int wave ) const
 	{
 		assert( wave>=0 && wave<wave_defs_.size() );
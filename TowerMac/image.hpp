@@ -10,6 +10,14 @@
 #endif
 
 #include <iostream>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "framebuffer.hpp"
+#include "logger.hpp"
 
 extern SDL_Renderer *gRenderer;
 
@@ -19,8 +27,60 @@ class image
 	SDL_Texture* texture_;	///	The SDL texture containing the image
 	SDL_Rect rect_;			///	The bounds of the image
 
+	///	Where each quarter turn of the image lives in the texture
+	///	Rotatable images are pre-rendered in their four orientations, side by side, so drawing is a plain copy
+	SDL_Rect frames_[4];
+	bool rotatable_ = false;
+
 	bool offset_ = true;	///	If true, we draw it centered (#### it should no be there)
 
+	///	The 1-bit conversion of each frame, only when the framebuffer backend is selected
+	bitmap bitmaps_[4];
+
+	void make_bitmaps( SDL_Surface *s )
+	{
+		if (!framebuffer::screen)
+			return;
+		for (int i=0;i!=(rotatable_?4:1);i++)
+			bitmaps_[i] = bitmap{ s, frames_[i] };
+	}
+
+	///	Creates a surface with the four orientations of s, clockwise, side by side
+	SDL_Surface *make_atlas( SDL_Surface *s )
+	{
+		auto src = SDL_ConvertSurfaceFormat( s, SDL_PIXELFORMAT_ARGB8888, 0 );
+		assert( src );
+		int w = src->w;
+		int h = src->h;
+		auto atlas = SDL_CreateRGBSurfaceWithFormat( 0, 2*(w+h), std::max( w, h ), 32, SDL_PIXELFORMAT_ARGB8888 );
+		assert( atlas );
+
+		frames_[0] = { 0, 0, w, h };
+		frames_[1] = { w, 0, h, w };
+		frames_[2] = { w+h, 0, w, h };
+		frames_[3] = { 2*w+h, 0, h, w };
+
+		SDL_LockSurface( src );
+		SDL_LockSurface( atlas );
+		auto pixel = [&]( int frame, int x, int y ) -> uint32_t & { return ((uint32_t *)((char *)atlas->pixels+y*atlas->pitch))[frames_[frame].x+x]; };
+		for (int y=0;y!=h;y++)
+		{
+			auto line = (const uint32_t *)((const char *)src->pixels+y*src->pitch);
+			for (int x=0;x!=w;x++)
+			{
+				pixel( 0, x, y ) = line[x];
+				pixel( 1, h-1-y, x ) = line[x];
+				pixel( 2, w-1-x, h-1-y ) = line[x];
+				pixel( 3, y, w-1-x ) = line[x];
+			}
+		}
+		SDL_UnlockSurface( atlas );
+		SDL_UnlockSurface( src );
+		SDL_FreeSurface( src );
+
+		return atlas;
+	}
+
 public:
 	image( SDL_Surface *s, bool offset ) : offset_{ offset }
 	{
@@ -28,20 +88,34 @@ public:
 		texture_ = SDL_CreateTextureFromSurface( gRenderer, s );
 		assert( texture_ );
 		rect_ = s->clip_rect;
+		frames_[0] = rect_;
+		make_bitmaps( s );
 	}
 
-	image( const char *s, bool offset = true ) : offset_{ offset }
+	image( const char *s, bool offset = true, bool rotatable = false ) : rotatable_{ rotatable }, offset_{ offset }
 	{
 		SDL_Surface *image_ = IMG_Load( s );
 		if (!image_)
 		{
-			std::cerr << "Cannot load image [" << s << "]\n";
+			logger::error( logger::kGraphics, "cannot load image", "file", s );
 			throw "Cannot load image";
 		}
 		assert( image_ );
-		texture_ = SDL_CreateTextureFromSurface( gRenderer, image_ );
-		assert( texture_ );
 		rect_ = image_->clip_rect;
+		frames_[0] = rect_;
+		if (rotatable_)
+		{
+			auto atlas = make_atlas( image_ );
+			texture_ = SDL_CreateTextureFromSurface( gRenderer, atlas );
+			make_bitmaps( atlas );
+			SDL_FreeSurface( atlas );
+		}
+		else
+		{
+			texture_ = SDL_CreateTextureFromSurface( gRenderer, image_ );
+			make_bitmaps( image_ );
+		}
+		assert( texture_ );
 		SDL_FreeSurface( image_ );
 	}
 
@@ -50,32 +124,81 @@ public:
 		SDL_DestroyTexture( texture_ );
 	}
 
+	///	Draws the image, rotated by 'rotate' quarter turns clockwise around its center
 	void render( const point &p, int rotate=0 ) const
 	{
-		SDL_Rect dst_rect = rect_;
-		if (offset_)
+		rotate &= 3;
+		const SDL_Rect &frame = rotatable_?frames_[rotate]:rect_;
+
+		int cx = (int)p.x;
+		int cy = (int)p.y;
+		if (!offset_)
 		{
-			dst_rect.x = (int)p.x-rect_.w/2;
-			dst_rect.y = (int)p.y-rect_.h/2;
+			cx += rect_.w/2;
+			cy += rect_.h/2;
 		}
+		SDL_Rect dst_rect = { cx-frame.w/2, cy-frame.h/2, frame.w, frame.h };
+
+			//	The 1-bit backend only has the pre-rotated frames
+		if (framebuffer::screen)
+		{
+			framebuffer::screen->blit( bitmaps_[rotatable_?rotate:0], dst_rect.x, dst_rect.y );
+			return;
+		}
+
+		int result;
+		if (rotatable_ || rotate==0)
+			result = SDL_RenderCopy( gRenderer, texture_, &frame, &dst_rect );
 		else
 		{
-			dst_rect.x = (int)p.x;
-			dst_rect.y = (int)p.y;
+			dst_rect = { cx-rect_.w/2, cy-rect_.h/2, rect_.w, rect_.h };
+			result = SDL_RenderCopyEx( gRenderer, texture_, &rect_, &dst_rect, rotate*90, nullptr, SDL_FLIP_NONE );
 		}
-		int result = SDL_RenderCopyEx( gRenderer, texture_, &rect_, &dst_rect, rotate*90, nullptr, SDL_FLIP_NONE );
 		// int result  = SDL_BlitScaled( image_, &rect_, gScreen, &dst_rect );
 		// int result  = SDL_BlitSurface( image_, &rect_, gScreen, &dst_rect );
 		if (result<0)
 		{
-			std::cerr << "Error = " << result << "\n";
+			logger::error( logger::kGraphics, "render copy failed", "result", result );
 			throw "Blit error";
 		}
 	}
 	
+	///	Returns the image loaded from that file, shared by all its users
+	///	Loaded on first use, and kept until the end of the program
+	///	Only the main thread may load images: the simulation thread expects them to be preloaded
+	static const image &named( const std::string &name, bool rotatable = false )
+	{
+		static std::map<std::pair<std::string,bool>,std::unique_ptr<image>> images;
+		static std::mutex lock;
+		std::lock_guard<std::mutex> guard( lock );
+		auto &res = images[{ name, rotatable }];
+		if (!res)
+			res = std::make_unique<image>( name.c_str(), true, rotatable );
+		return *res;
+	}
+
+	///	The 1-bit version of the image (framebuffer backend only)
+	const bitmap &bits() const { return bitmaps_[0]; }
+
 	size_t height() const { return rect_.h; }
 	size_t width() const { return rect_.w; }
 	size size() const { return { (size_t)rect_.h, (size_t)rect_.w}; }
 };
 
+///	An image, where it is drawn and how it is rotated, as captured for rendering
+///	Moving objects are drawn in between their position at the previous tick and the current one
+struct sprite
+{
+	const image *img = nullptr;
+	point from;
+	point to;
+	int rotate = 0;
+
+	void render( double alpha=1 ) const
+	{
+		auto lerp = [alpha]( size_t a, size_t b ) { return (size_t)(a+((double)b-(double)a)*alpha); };
+		img->render( { lerp( from.x, to.x ), lerp( from.y, to.y ) }, rotate );
+	}
+};
+
 #endif
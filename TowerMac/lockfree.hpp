@@ -0,0 +1,137 @@
+//
+//  lockfree.hpp
+//  TowerMac
+//
+
+#ifndef LOCKFREE_INCLUDED__
+#define LOCKFREE_INCLUDED__
+
+#include <atomic>
+#include <cstddef>
+
+///	Three buffers shared by one writer and one reader, none of them ever waits
+///	The writer fills back() then publish()es it, the reader gets the last published one with front()
+///	Buffers are reused, so the writer should overwrite everything it cares about
+template <typename T> class triple_buffer
+{
+	static const int kFresh = 4;	///	Set on the middle index when it has not been read yet
+
+	T buffers_[3];
+	int back_ = 0;					///	Owned by the writer
+	std::atomic<int> middle_{ 1 };	///	Exchanged between the two
+	int front_ = 2;					///	Owned by the reader
+
+public:
+	T &back() { return buffers_[back_]; }
+
+	void publish() { back_ = middle_.exchange( back_|kFresh, std::memory_order_acq_rel )&3; }
+
+	const T &front()
+	{
+		if (middle_.load( std::memory_order_relaxed )&kFresh)
+			front_ = middle_.exchange( front_, std::memory_order_acq_rel )&3;
+		return buffers_[front_];
+	}
+};
+
+///	A fixed size queue, for one producer thread and one consumer thread
+template <typename T, size_t N> class spsc_queue
+{
+	static_assert( (N&(N-1))==0, "N must be a power of two" );
+
+	T items_[N];
+	std::atomic<size_t> head_{ 0 };	///	Next item to pop, written by the consumer
+	std::atomic<size_t> tail_{ 0 };	///	Next item to push, written by the producer
+
+public:
+	///	Returns false if the queue is full
+	bool push( const T &item )
+	{
+		auto tail = tail_.load( std::memory_order_relaxed );
+		if (tail-head_.load( std::memory_order_acquire )==N)
+			return false;
+		items_[tail&(N-1)] = item;
+		tail_.store( tail+1, std::memory_order_release );
+		return true;
+	}
+
+	///	Returns false if the queue is empty
+	bool pop( T &item )
+	{
+		auto head = head_.load( std::memory_order_relaxed );
+		if (head==tail_.load( std::memory_order_acquire ))
+			return false;
+		item = items_[head&(N-1)];
+		head_.store( head+1, std::memory_order_release );
+		return true;
+	}
+
+	bool empty() const { return head_.load( std::memory_order_acquire )==tail_.load( std::memory_order_acquire ); }
+};
+
+///	A fixed size queue, for any number of producer threads and one consumer thread
+///	Each cell has a sequence number, which tells whose turn it is: producers claim a cell by moving
+///	tail_ forward, fill it, then hand it to the consumer by bumping its sequence
+template <typename T, size_t N> class mpsc_queue
+{
+	static_assert( (N&(N-1))==0, "N must be a power of two" );
+
+	struct cell
+	{
+		std::atomic<size_t> sequence;	///	index: free for the producer at index, index+1: ready for the consumer
+		T item;
+	};
+
+	cell cells_[N];
+	std::atomic<size_t> tail_{ 0 };	///	Next cell to claim, shared by the producers
+	size_t head_ = 0;				///	Next cell to pop, owned by the consumer
+
+public:
+	mpsc_queue()
+	{
+		for (size_t i=0;i!=N;i++)
+			cells_[i].sequence.store( i, std::memory_order_relaxed );
+	}
+	mpsc_queue( const mpsc_queue & ) = delete;
+
+	///	Returns false if the queue is full
+	bool push( const T &item )
+	{
+		auto tail = tail_.load( std::memory_order_relaxed );
+		cell *c;
+		for (;;)
+		{
+			c = &cells_[tail&(N-1)];
+			auto sequence = c->sequence.load( std::memory_order_acquire );
+			if (sequence==tail)
+			{
+				if (tail_.compare_exchange_weak( tail, tail+1, std::memory_order_relaxed ))
+					break;
+			}
+			else if (sequence<tail)
+				return false;		//	Not popped yet since the last round
+			else
+				tail = tail_.load( std::memory_order_relaxed );		//	Claimed by another producer
+		}
+		c->item = item;
+		c->sequence.store( tail+1, std::memory_order_release );
+		return true;
+	}
+
+	///	Returns false if the queue is empty
+	bool pop( T &item )
+	{
+		auto &c = cells_[head_&(N-1)];
+		if (c.sequence.load( std::memory_order_acquire )!=head_+1)
+			return false;
+		item = c.item;
+		c.sequence.store( head_+N, std::memory_order_release );
+		head_++;
+		return true;
+	}
+
+	///	From the consumer thread only
+	bool empty() const { return cells_[head_&(N-1)].sequence.load( std::memory_order_acquire )!=head_+1; }
+};
+
+#endif
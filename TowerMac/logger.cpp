@@ -0,0 +1,125 @@
+//
+//  logger.cpp
+//  TowerMac
+//
+
+#include "logger.hpp"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+static const char kLevelNames[] = "DIWE";
+static const char *kCategoryNames[logger::kCategoryCount] = { "main", "sim", "defs", "gfx", "sound", "input", "perf" };
+
+	//	Constructed on first use, so it works from the constructors of other statics (like game_def::spec)
+	//	and is destroyed after them
+logger &logger::instance()
+{
+	static logger instance;
+	return instance;
+}
+
+logger::logger()
+{
+	if (auto level = getenv( "TM_LOG_LEVEL" ))
+	{
+		const char *names[] = { "debug", "info", "warning", "error" };
+		for (int i=0;i!=4;i++)
+			if (!strcmp( level, names[i] ))
+				level_ = i;
+	}
+	thread_ = std::thread{ [this]{ run(); } };
+}
+
+logger::~logger()
+{
+	quit_ = true;
+	thread_.join();
+}
+
+uint64_t logger::now() const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now()-start_ ).count();
+}
+
+void logger::flush()
+{
+	auto &l = instance();
+	auto pushed = l.pushed_.load( std::memory_order_acquire );
+	while (l.written_.load( std::memory_order_acquire )<pushed && !l.quit_)
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+}
+
+	//	"  12.345 I sim   message key=value key=value"
+void logger::write( const record &r )
+{
+	char line[512];
+	auto size = sizeof(line);
+	auto n = snprintf( line, size, "%8.3f %c %-5s %s", r.time/1e9, kLevelNames[r.level], kCategoryNames[r.category], r.message );
+	for (size_t i=0;i!=r.field_count && n<(int)size;i++)
+	{
+		auto &f = r.fields[i];
+		auto rest = size-n;
+		switch (f.type)
+		{
+			case field::kInt:
+				n += snprintf( line+n, rest, " %s=%" PRId64, f.key, f.i );
+				break;
+			case field::kUnsigned:
+				n += snprintf( line+n, rest, " %s=%" PRIu64, f.key, f.u );
+				break;
+			case field::kDouble:
+				n += snprintf( line+n, rest, " %s=%g", f.key, f.d );
+				break;
+			case field::kPointer:
+				n += snprintf( line+n, rest, " %s=%p", f.key, f.p );
+				break;
+			case field::kText:
+				n += snprintf( line+n, rest, " %s=%.*s", f.key, (int)f.text.length, r.text+f.text.offset );
+				break;
+		}
+	}
+	if (n>=(int)size)
+		n = (int)size-1;		//	Truncated: only the text before the terminating NUL
+	line[n++] = '\n';		//	In place of the NUL
+	std::clog.write( line, n );
+}
+
+void logger::run()
+{
+	size_t reported = 0;	///	Drops already written
+	record r;
+	for (;;)
+	{
+		bool written = false;
+		while (ring_.pop( r ))
+		{
+			write( r );
+			written_.fetch_add( 1, std::memory_order_release );
+			written = true;
+		}
+
+		auto dropped = dropped_.load( std::memory_order_relaxed );
+		if (dropped!=reported)
+		{
+			char line[64];
+			auto n = snprintf( line, sizeof(line), "%8.3f W main  log ring full dropped=%zu\n", now()/1e9, dropped-reported );
+			std::clog.write( line, n );
+			reported = dropped;
+			written = true;
+		}
+
+		if (written)
+			std::clog.flush();
+		else if (quit_)
+			break;
+		else
+		{
+			int ms = kIdleMs;
+			std::this_thread::sleep_for( std::chrono::milliseconds( ms ) );
+		}
+	}
+}
@@ -0,0 +1,220 @@
+//
+//  logger.hpp
+//  TowerMac
+//
+
+#ifndef LOGGER_INCLUDED__
+#define LOGGER_INCLUDED__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include "lockfree.hpp"
+
+///	Logging with levels and categories, cheap enough for the simulation thread
+///	A call copies its message and fields into a fixed size binary record, pushed in a lock-free ring
+///	A background thread formats the records and writes them to std::clog
+///	Logging does not wait for the writer: when the ring is full, the record is dropped, and the drops are counted and reported
+///	The exceptions are error(), which waits until the error is written, and flush()
+///
+///		logger::info( logger::kSimulation, "mob destroyed", "mob", m, "hp", hp );
+///
+///	Messages and keys must be string literals, as only their address is kept. Text values are copied
+///	The level is set with TM_LOG_LEVEL (debug, info, warning or error), info by default
+class logger
+{
+public:
+	enum eLevel : uint8_t
+	{
+		kDebug,
+		kInfo,
+		kWarning,
+		kError
+	};
+
+	enum eCategory : uint8_t
+	{
+		kGeneral,
+		kSimulation,
+		kDefinitions,
+		kGraphics,
+		kSound,
+		kInput,
+		kPerf,
+		kCategoryCount
+	};
+
+private:
+	static const size_t kMaxFields = 6;
+	static const size_t kTextSize = 96;		///	For all the text values of a record
+	static const size_t kRingSize = 2048;
+	static const int kIdleMs = 10;			///	How long the writer sleeps when there is nothing to write
+
+	struct field
+	{
+		enum eType : uint8_t
+		{
+			kInt,
+			kUnsigned,
+			kDouble,
+			kPointer,
+			kText
+		}	type;
+		const char *key;
+		union
+		{
+			int64_t i;
+			uint64_t u;
+			double d;
+			const void *p;
+			struct
+			{
+				uint16_t offset;
+				uint16_t length;
+			}	text;
+		};
+	};
+
+	struct record
+	{
+		uint64_t time;			///	Nanoseconds since the logger started
+		const char *message;
+		eLevel level;
+		eCategory category;
+		uint8_t field_count;
+		uint16_t text_length;
+		field fields[kMaxFields];
+		char text[kTextSize];
+	};
+
+	mpsc_queue<record,kRingSize> ring_;
+
+	std::atomic<int> level_{ kInfo };
+	std::atomic<uint32_t> categories_{ ~0u };	///	Bit set of the enabled eCategory
+
+	std::atomic<size_t> pushed_{ 0 };
+	std::atomic<size_t> written_{ 0 };		///	Catches up with pushed_, for flush()
+	std::atomic<size_t> dropped_{ 0 };
+
+	std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+
+	std::atomic<bool> quit_{ false };
+	std::thread thread_;
+
+	logger();
+	~logger();
+
+	static logger &instance();
+
+	uint64_t now() const;
+	void run();
+	void write( const record &r );
+
+	bool enabled( eLevel level, eCategory category ) const
+	{
+		return level>=level_.load( std::memory_order_relaxed ) && (categories_.load( std::memory_order_relaxed )&(1u<<category));
+	}
+
+	void push( const record &r )
+	{
+		if (ring_.push( r ))
+			pushed_.fetch_add( 1, std::memory_order_release );
+		else
+			dropped_.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+		//	Field values
+	static field &add( record &r, const char *key, field::eType type )
+	{
+		auto &f = r.fields[r.field_count++];
+		f.key = key;
+		f.type = type;
+		return f;
+	}
+
+	static void set( record &r, const char *key, const char *v, size_t length )
+	{
+		if (length>kTextSize-r.text_length)
+			length = kTextSize-r.text_length;		//	Truncated
+		auto &f = add( r, key, field::kText );
+		f.text = { r.text_length, (uint16_t)length };
+		memcpy( r.text+r.text_length, v, length );
+		r.text_length += length;
+	}
+	static void set( record &r, const char *key, const char *v ) { set( r, key, v?v:"(null)", strlen( v?v:"(null)" ) ); }
+	static void set( record &r, const char *key, char *v ) { set( r, key, (const char *)v ); }
+	static void set( record &r, const char *key, const std::string &v ) { set( r, key, v.data(), v.size() ); }
+	static void set( record &r, const char *key, char v ) { set( r, key, &v, 1 ); }
+	static void set( record &r, const char *key, bool v ) { add( r, key, field::kUnsigned ).u = v; }
+	template <typename T> static void set( record &r, const char *key, const T *v ) { add( r, key, field::kPointer ).p = v; }
+	template <typename T> static typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type set( record &r, const char *key, T v )
+	{
+		if (std::is_floating_point<T>::value)
+			add( r, key, field::kDouble ).d = (double)v;
+		else if (std::is_signed<T>::value)
+			add( r, key, field::kInt ).i = (int64_t)v;
+		else
+			add( r, key, field::kUnsigned ).u = (uint64_t)v;
+	}
+
+	static void set_fields( record & ) {}
+	template <typename V, typename... A> static void set_fields( record &r, const char *key, const V &v, const A &... a )
+	{
+		static_assert( sizeof...(a)/2<kMaxFields, "Too many log fields" );
+		set( r, key, v );
+		set_fields( r, a... );
+	}
+
+	template <typename... A> static void log( eLevel level, eCategory category, const char *message, const A &... a )
+	{
+		static_assert( sizeof...(a)%2==0, "Log fields are key, value pairs" );
+		auto &l = instance();
+		if (!l.enabled( level, category ))
+			return;
+		record r;
+		r.time = l.now();
+		r.message = message;
+		r.level = level;
+		r.category = category;
+		r.field_count = 0;
+		r.text_length = 0;
+		set_fields( r, a... );
+		l.push( r );
+	}
+
+public:
+	logger( const logger & ) = delete;
+
+	template <typename... A> static void debug( eCategory category, const char *message, const A &... a ) { log( kDebug, category, message, a... ); }
+	template <typename... A> static void info( eCategory category, const char *message, const A &... a ) { log( kInfo, category, message, a... ); }
+	template <typename... A> static void warning( eCategory category, const char *message, const A &... a ) { log( kWarning, category, message, a... ); }
+
+	///	Errors are written before returning, as they often come right before a throw
+	template <typename... A> static void error( eCategory category, const char *message, const A &... a )
+	{
+		log( kError, category, message, a... );
+		flush();
+	}
+
+	static void set_level( eLevel level ) { instance().level_ = level; }
+	static void set_category( eCategory category, bool enabled )
+	{
+		if (enabled)
+			instance().categories_ |= 1u<<category;
+		else
+			instance().categories_ &= ~(1u<<category);
+	}
+
+	///	Waits until everything logged so far is written
+	static void flush();
+
+	///	Records lost because the ring was full
+	static size_t dropped() { return instance().dropped_.load( std::memory_order_relaxed ); }
+};
+
+#endif
@@ -9,6 +9,7 @@
 #include <cassert>
 #include <vector>
 #include <algorithm>
+#include <cstring>
 
 #include <SDL2/SDL.h>
 
@@ -23,82 +24,14 @@ SDL_Renderer *gRenderer = nullptr;
 #include "game.hpp"
 #include "font.hpp"
 #include "ui.hpp"
-
-class mob_scheduler
-{
-	/// An mob creation at a certain timestamp on a certain lane
-	class spawn_event
-	{
-		protected:
-		size_t timestamp_;
-		mob *mob_;
-	public:
-		spawn_event( size_t timestamp, mob *mob ) :
-			timestamp_{ timestamp },
-			mob_{ mob }
-		{}
-		bool operator<( const spawn_event &o ) const { return timestamp_<o.timestamp_; }
-		bool operator==( const spawn_event &o ) const { return timestamp_==o.timestamp_; }
-		friend mob_scheduler;
-	};
-
-	std::vector<spawn_event> events_; //  ordered
-	std::vector<spawn_event>::const_iterator current_;
-
-
-public:
-	void add_event( size_t ts, mob *mob )
-	{
-		events_.emplace_back( ts, mob );
-	}
-
-	void prepare()
-	{
-		std::sort(std::begin(events_),std::end(events_));
-		current_ = std::begin(events_);
-	}
-
-	bool empty() const { return current_==std::end(events_); }
-	
-	bool step( simulation &simulation )
-	{
-		if (empty())
-			return false;
-		auto ts = simulation.timestamp();
-		while (ts==current_->timestamp_)
-		{
-			simulation.register_mob( current_->mob_ );
-			current_++;
-		}
-		return true;
-	}
-};
-
-mob_scheduler schedule_wave( const wave_def &wave, simulation &simulation )
-{
-	mob_scheduler sched;
-	size_t ts;
-
-	for (auto &wl:wave.wavelets)
-	{
-		ts = 0;
-		for (auto &mg:wl.mob_groups)
-		{
-			ts += mg.spawn_delay;
-			for (int i=0;i!=mg.count;i++)
-			{
-				ts += mg.spawn_rate;
-				mob *m = new mob( simulation, *wl.path_, *mg.mob_def_ );
-				sched.add_event( ts, m );
-			}
-			ts -= mg.spawn_rate;
-		}
-	}
-
-	sched.prepare();
-
-	return sched;
-}
+#include "scheduler.hpp"
+#include "sim_thread.hpp"
+#include "map_layer.hpp"
+#include "pacer.hpp"
+#include "perf_hud.hpp"
+#include "def_watcher.hpp"
+#include "logger.hpp"
+#include "particles.hpp"
 
 SDL_Window* window_ = NULL;
 
@@ -110,6 +43,8 @@ class game_loop
 
 	image map_background_{ "assets/general/map.bmp", false };
 	image map_background_gray_{ "assets/general/map-gray.bmp", false };
+	map_layer map_layer_;		///	Background, plus lanes during placement or base during the game
+	int map_layer_content_ = -1;	///	What is currently composited in map_layer_
 	
 	enum eGameState
 	{
@@ -124,13 +59,44 @@ class game_loop
 
 	eGameState state_ = kTowerPlacement;
 
-	size_t ticks_ = 0;
+	size_t ticks_ = 0;			///	Simulation ticks, also drive the animations
+
+	static const size_t kTicksPerSecond = 30;
+	frame_pacer pacer_{ kTicksPerSecond, display_refresh() };
+	double alpha_ = 1;			///	Where the frame being rendered is, between the last two ticks
+
+	perf_hud *hud_ = nullptr;	///	F1 shows or hides it (owned by the view hierarchy)
+
+	static int display_refresh()
+	{
+		SDL_DisplayMode mode;
+		if (SDL_GetCurrentDisplayMode( 0, &mode )<0)
+			return 0;
+		return mode.refresh_rate;
+	}
 
 	std::unique_ptr<game> game_;
 	std::unique_ptr<simulation> simulation_;
 
 	mob_scheduler scheduler_;
 
+	///	Runs simulation_ while a wave is in progress (destroyed first, as it uses the simulation)
+	sim_thread sim_;
+
+	///	With '--flow', mobs walk around the towers to the base instead of following their lane
+	std::unique_ptr<flow_field> flow_;
+	std::vector<const spot *> obstacles_;	///	Spots blocked in flow_
+
+	///	Hits, kills and base damage of the wave in progress, unless '--no-particles'
+	bool particles_on_;
+	sim_event_queue events_;
+	particle_system particles_;
+
+	const spot *hovered_ = nullptr;		///	Open spot under the mouse during placement, its coverage is shown
+
+	///	Definitions edited while the game runs are applied before the next wave
+	def_watcher def_watcher_{ "assets/defs" };
+
 	void do_user_input()
 	{
 		SDL_Event e;
@@ -139,13 +105,15 @@ class game_loop
 			if (e.type == SDL_QUIT)
 			{
 				state_ = kGameExiting;
-				std::clog << "SDL_QUIT\n";
+				logger::info( logger::kInput, "quit" );
 			}
 			else if (e.key.keysym.sym==SDLK_ESCAPE || e.key.keysym.sym==SDLK_LCTRL)
 			{
 				state_ = kGameExiting;
-				std::clog << "ESC/CTRL\n";
+				logger::info( logger::kInput, "exit key" );
 			}
+			else if (e.type == SDL_KEYDOWN && e.key.keysym.sym==SDLK_F1)
+				hud_->toggle();
 
 			switch (state_)
 			{
@@ -156,6 +124,14 @@ class game_loop
 						state_ = kGameStep;
 					break;
 				case kTowerPlacement:
+					if (e.type == SDL_MOUSEMOTION)
+					{
+						point p{ e.motion.x/ZoomFactor, e.motion.y/ZoomFactor };
+						hovered_ = nullptr;
+						for (auto s:game_->open_spots())
+							if (s->contains(p))
+								hovered_ = s;
+					}
 					if (e.type == SDL_MOUSEBUTTONDOWN)
 					{
 						point p{ e.button.x/ZoomFactor, e.button.y/ZoomFactor };
@@ -171,11 +147,16 @@ class game_loop
 						if (!found)
 							break;
 
+						hovered_ = nullptr;
+						update_obstacles();
 						simulation_ = std::make_unique<simulation>();
+						simulation_->set_flow_field( flow_.get() );
+						simulation_->set_event_queue( particles_on_?&events_:nullptr );
 
 						game_->apply( *simulation_ );
 
-						scheduler_ = schedule_wave( game_def::spec.get_wave(0), *simulation_ );
+						scheduler_ = schedule_wave( game_def::spec.get_wave(0) );
+						sim_.start( *simulation_, scheduler_ );
 						state_ = kGameRunning;
 					}
 					break;
@@ -185,6 +166,7 @@ class game_loop
 					if (e.type == SDL_MOUSEMOTION)
 					{
 						target_ = point{ e.button.x/ZoomFactor, e.button.y/ZoomFactor };
+						sim_.set_target( target_ );
 					}
 					break;
 				default:
@@ -198,13 +180,103 @@ class game_loop
 	{
 		if (state_==kGameRunning || state_==kGameStep)
 		{
-			simulation_->set_target( target_ );
-			scheduler_.step( *simulation_ );
-			simulation_->step();
+			sim_.tick();
+			if (particles_on_)
+			{
+				particles_.emit_all( events_ );
+				particles_.step();
+			}
 		}
 
 		if (state_==kGameStep)
 			state_ = kGamePaused;
+
+		ticks_++;
+	}
+
+	///	The snapshot of the wave in progress, if there is one
+	const render_snapshot *live_snapshot()
+	{
+		if (!simulation_)
+			return nullptr;
+		auto &s = sim_.snapshot();
+		return s.wave==sim_.wave()?&s:nullptr;
+	}
+
+	///	Ends the wave when the last snapshot says so
+	void do_wave_end()
+	{
+		auto s = live_snapshot();
+		if (!s || (!s->game_over && !s->finished))
+			return;
+
+		bool game_over = s->game_over;
+		sim_.stop();
+		simulation_ = nullptr;
+		particles_.emit_all( events_ );		//	Drains the last events
+		particles_.clear();
+		state_ = kTowerPlacement;
+		if (game_over)
+		{
+			game_ = game::load( "/tmp/1.tm" );
+			update_obstacles();
+		}
+		else
+			game_->save( "/tmp/1.tm" );
+	}
+
+	///	Towers are obstacles in the flow field: blocks the spots that got one, frees the ones that lost it
+	void update_obstacles()
+	{
+		if (!flow_)
+			return;
+		auto &open = game_->open_spots();
+		for (auto s:game_def::spec.spot_defs())
+		{
+			bool has_tower = std::find( open.begin(), open.end(), s )==open.end();
+			auto o = std::find( obstacles_.begin(), obstacles_.end(), s );
+			if (has_tower && o==obstacles_.end())
+			{
+				flow_->block( s->footprint() );
+				obstacles_.push_back( s );
+			}
+			else if (!has_tower && o!=obstacles_.end())
+			{
+				flow_->unblock( s->footprint() );
+				obstacles_.erase( o );
+			}
+		}
+	}
+
+	///	Swaps in the definitions that changed on disk, only between waves
+	void do_reload()
+	{
+		if (state_!=kTowerPlacement)
+			return;
+		auto update = def_watcher_.take();
+		if (update && game_def::spec.apply( std::move( *update ) ))
+		{
+			sim_thread::preload_images();
+			map_layer_content_ = -1;		//	Lanes are on the map layer
+		}
+	}
+
+	///	Feeds the HUD with the numbers of this frame
+	void do_stats()
+	{
+		perf_sample sample;
+		sample.frame_time = pacer_.frame_time();
+		sample.render_time = screen_->draw_time();
+		sample.audio_time = sound_manager::sm.callback_time();
+		if (auto s = live_snapshot())
+		{
+			sample.tick_time = s->tick_time;
+			sample.mobs = s->mobs.size();
+			sample.bullets = s->bullets.size();
+			sample.arena_objects = s->arena_objects;
+			sample.arena_blocks = s->arena_blocks;
+		}
+		hud_->add_sample( sample );
 	}
 
 	void draw_spot( const spot &s )
@@ -222,13 +294,39 @@ class game_loop
 
 	void draw_path( const path &path )
 	{
+		auto pixels = path.pixels();
+		if (framebuffer::screen)
+		{
+			for (auto &p:pixels)
+				framebuffer::screen->set_pixel( (int)p.x, (int)p.y, true );
+			return;
+		}
 		SDL_SetRenderDrawColor( gRenderer, 255, 0, 0, 255 );
-		for (auto &p:path.get_points())
+		for (auto &p:pixels)
 			SDL_RenderDrawPoint( gRenderer, (int)p.x, (int)p.y );
 	}
 
+	///	The parts of the lanes a tower on the spot would reach
+	void draw_coverage( const spot &s )
+	{
+		auto &c = game_def::spec.get_coverage( &s, game_->get_loadout().stats_for( &s ).range );
+		if (!framebuffer::screen)
+			SDL_SetRenderDrawColor( gRenderer, 0, 255, 0, 255 );
+		for (auto &i:c.intervals())
+			for (auto &p:i.lane->pixels( i.begin, i.end ))
+					//	Thicker than the lane, so it shows in 1 bit too
+				for (int dy=-1;dy<=1;dy++)
+					for (int dx=-1;dx<=1;dx++)
+						if (framebuffer::screen)
+							framebuffer::screen->set_pixel( (int)p.x+dx, (int)p.y+dy, true );
+						else
+							SDL_RenderDrawPoint( gRenderer, (int)p.x+dx, (int)p.y+dy );
+	}
+
 	void do_render()
 	{
+			//	Only a running game moves between ticks
+		alpha_ = state_==kGameRunning?pacer_.alpha():1;
 		screen_->draw();
 
 //		font::normal->render_text( { 20, 20 } , "Hello, World" );
@@ -240,42 +338,63 @@ class game_loop
 //        SDL_UpdateWindowSurface(window);
 
 //		SDL_RenderPresent( gRenderer );
-
-		ticks_++;
 	}
 
 public:
-	game_loop()
+	game_loop( bool flow, bool particles ) : particles_on_{ particles }
 	{
 		screen_ = window::make_window();
 
+		if (flow)
+		{
+			flow_ = std::make_unique<flow_field>( point{ kMapX, kMapY }, MAP_SIZE, MAP_SIZE );
+			flow_->set_goal( { { kBaseX, kBaseY }, { kBaseWidth, kBaseHeight } } );
+			flow_->compute();
+		}
+
 		auto cv = new custom_view( {MAP_SIZE, MAP_SIZE}, [&](custom_view &,graphics&){
-			map_background_gray_.render( point{ kMapX, kMapY } );
+				//	The simulation belongs to the simulation thread, we only draw its last snapshot
+			auto snapshot = live_snapshot();
+
+				//	Lanes during placement, the base during a wave
+			int content = (state_==kTowerPlacement?1:0)|(snapshot?2:0);
+			if (content!=map_layer_content_)
+			{
+				map_layer_.invalidate();
+				map_layer_content_ = content;
+			}
+			map_layer_.render( [&]{
+				map_background_gray_.render( point{ kMapX, kMapY } );
+
+				if (state_==kTowerPlacement)
+					for (auto p:game_def::spec.get_lanes(0))
+						draw_path( *p );
+
+				if (snapshot)
+					snapshot->base.render();
+			} );
 
 			if (state_==kTowerPlacement)
 			{
 				for (auto s:game_->open_spots())
 					draw_spot( *s );
-			
-				for (auto p:game_def::spec.get_lanes(0))
-					draw_path( *p );
+				if (hovered_)
+					draw_coverage( *hovered_ );
 			}
 
-			if (simulation_)
+			if (snapshot)
 			{
-				simulation_->get_base().render();
+				for (auto &t:snapshot->towers)       //  #### not simulation, game
+					t.render();
 
-				for (auto t:simulation_->get_towers())       //  #### not simulation, game
-					t->render();
+				for (auto &m:snapshot->mobs)
+					m.render( alpha_ );
 
-				if (state_==kGameRunning || state_==kGamePaused || state_==kGameStep)
-				{
-					for (auto m=simulation_->get_mobs()->begin();m!=simulation_->get_mobs()->end();m=m->next_)
-						m->render();
+				for (auto &b:snapshot->bullets)
+					b.render( alpha_ );
 
-					for (auto b=simulation_->get_bullets()->begin();b!=simulation_->get_bullets()->end();b=b->next_)
-						b->render();
-				}
+				if (particles_on_)
+					particles_.draw();
 			}
 		} );
 		screen_->root().add( cv, {kMapX,kMapY} );
@@ -298,6 +417,10 @@ public:
 		auto v4 = new static_text( styled_string{ "This is a very long string that is over several lines, and is fully justified!\nIt even contains two separate paragraphs, which is unheard of...", font::normal.get() }, 62 );
 		screen_->root().add( v4, { 245,120 } );
 
+			//	Added last, so it is drawn over everything else
+		hud_ = new perf_hud( pacer_.period() );
+		hud_->set_hidden( true );
+		screen_->root().add( hud_, { SCREEN_WIDTH-hud_->frame().s.w-3, 3 } );
 		
 		
 		game_ = std::make_unique<game>();
@@ -313,44 +436,18 @@ public:
 
 	bool step()
 	{
-		uint32_t start_time = SDL_GetTicks();
-  
+		auto ticks = pacer_.begin_frame();
+
 		do_user_input();
-		do_physics();
+		for (size_t i=0;i!=ticks;i++)
+			do_physics();
+		do_wave_end();
+		do_reload();
+		do_stats();
 		do_render();
 
-		uint32_t duration = SDL_GetTicks()-start_time;
-
-		if (duration<33)
-		{
-			SDL_Delay( 33-duration );
-		}
-		else
-		{
-			std::clog << "#### Unsustainable framerate " << duration << "ms >= 33ms\n";
-			// std::clog << "Bullet count = " << simulation_.get_bullets().size() << "\n";
-			// std::clog << "Tower count = " << simulation_.get_towers().size() << "\n";
-			// std::clog << "Mob count = " << simulation_.get_mobs().size() << "\n";
-		}
+		pacer_.end_frame();
 
-		if (simulation_)
-		{
-			if (simulation_->game_over())
-			{
-				simulation_ = nullptr;
-				state_ = kTowerPlacement;
-				game_ = game::load( "/tmp/1.tm" );
-			}
-			else
-			{
-				if (scheduler_.empty() && !simulation_->has_mobs())
-				{
-					simulation_ = nullptr;
-					state_ = kTowerPlacement;
-					game_->save( "/tmp/1.tm" );
-				}
-			}
-		}
 		return state_==kGameExiting;
 	}
 };
@@ -384,16 +481,40 @@ int main(int argc, char* args[])
 	SDL_GL_GetDrawableSize(window_, &dw, &dh);
 	int retina_factor = ww == dw && wh == dh ? 1 : 2; // we need to double the renderer scale on retina displays, and this is sadly the simplest way to test for them.
 	
-	gRenderer =  SDL_CreateRenderer( window_, -1, SDL_RENDERER_ACCELERATED);
+	gRenderer =  SDL_CreateRenderer( window_, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC );
 	SDL_RenderSetScale( gRenderer, ZoomFactor * retina_factor, ZoomFactor * retina_factor);
+
+		//	'--1bit' draws everything in a 1-bit frame buffer, as on the SE/30
+		//	'--pbm <dir>' also saves every frame there
+		//	Must be decided before any image is loaded
+		//	'--flow' makes the mobs route around the towers
+		//	'--no-particles' turns the hit, kill and base damage effects off
+	bool flow = false;
+	bool particles = true;
+	for (int i=1;i<argc;i++)
+	{
+		if (!strcmp( args[i], "--flow" ))
+			flow = true;
+		else if (!strcmp( args[i], "--no-particles" ))
+			particles = false;
+		else if (!strcmp( args[i], "--1bit" ))
+			framebuffer::screen = std::make_unique<framebuffer>();
+		else if (!strcmp( args[i], "--pbm" ) && i+1<argc)
+		{
+			if (!framebuffer::screen)
+				framebuffer::screen = std::make_unique<framebuffer>();
+			framebuffer::screen->set_dump_directory( args[++i] );
+		}
+	}
+
 	font::init();
+	sim_thread::preload_images();
 
 	game_def::spec.wave_defs();
 	
-	game_loop gl;
+	game_loop gl( flow, particles );
 	
-	auto snd = sound_manager::sm.register_sound( "assets/general/sample.wav" );
-	sound_manager::sm.play_background( snd );
+	sound_manager::sm.play_music( "assets/general/sample.wav" );
 
 	try
 	{
@@ -402,7 +523,7 @@ int main(int argc, char* args[])
 	}
 	catch(const char *e)
 	{
-		std::cerr << e << '\n';
+		logger::error( logger::kGeneral, "fatal", "error", e );
 	}
 	
 	SDL_DestroyWindow( window_ );
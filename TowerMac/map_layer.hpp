@@ -0,0 +1,82 @@
+//
+//  map_layer.hpp
+//  TowerMac
+//
+
+#ifndef MAP_LAYER_INCLUDED__
+#define MAP_LAYER_INCLUDED__
+
+#include <functional>
+
+#include <SDL2/SDL.h>
+
+#include "core.hpp"
+#include "framebuffer.hpp"
+
+extern SDL_Renderer *gRenderer;
+
+///	The parts of the map that do not move: background, lanes and base
+///	They are composited once in an offscreen target, then drawn with a single copy per frame
+///	The owner calls invalidate() when what is on the layer changes
+class map_layer
+{
+	SDL_Texture *texture_ = nullptr;	///	Screen sized, so the layer is drawn at its usual coordinates
+	bitmap bits_;						///	The 1-bit backend keeps the composited map instead
+	bool valid_ = false;
+
+public:
+	map_layer() {}
+	map_layer( const map_layer & ) = delete;
+	map_layer &operator=( const map_layer & ) = delete;
+
+	~map_layer()
+	{
+		if (texture_)
+			SDL_DestroyTexture( texture_ );
+	}
+
+	void invalidate() { valid_ = false; }
+
+	///	Draws the layer, calling 'draw' first to composite it if needed
+	void render( const std::function<void()> &draw )
+	{
+		SDL_Rect r{ (int)kMapX, (int)kMapY, (int)MAP_SIZE, (int)MAP_SIZE };
+
+		if (auto fb = framebuffer::screen.get())
+		{
+			if (!valid_)
+			{
+				draw();
+				bits_ = fb->grab( r.x, r.y, r.w, r.h );
+				valid_ = true;
+			}
+			else
+				fb->blit( bits_, r.x, r.y );
+			return;
+		}
+
+		if (!texture_)
+			texture_ = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, SCREEN_WIDTH, SCREEN_HEIGHT );
+
+			//	Renderers without target textures just draw everything every frame
+		if (!texture_)
+		{
+			draw();
+			return;
+		}
+
+		if (!valid_)
+		{
+			SDL_SetRenderTarget( gRenderer, texture_ );
+			SDL_SetRenderDrawColor( gRenderer, 255, 255, 255, 255 );
+			SDL_RenderClear( gRenderer );
+			draw();
+			SDL_SetRenderTarget( gRenderer, nullptr );
+			valid_ = true;
+		}
+
+		SDL_RenderCopy( gRenderer, texture_, &r, &r );
+	}
+};
+
+#endif
@@ -7,54 +7,124 @@
 
 class mob : public node<mob>, public simulated
 {
+	handle handle_ = kNoHandle;		///	Set when registered in the simulation
+	friend class simulation;
+
 	const path &path_;
 
-	float position_ = 0;
+	scalar position_ = 0;
+	path::cursor cursor_;
+
+		//	With a flow field, the lane is only where the mob spawns, and position_ is the distance walked
+	const flow_field *field_;
+	point at_;
+	point previous_at_;		///	Location at the previous tick, for rendering in between
+	int rotation_;
 
-	image image_;
+	const image &image_;
 	size_t hp_;
-	float speed_;
+	scalar base_speed_;
+	scalar speed_;			///	After the status effects
 	size_t damage_;
 
+		//	Managed by the status effects of the simulation
+	int32_t effect_slots_[kEffectCount];	///	Index of the entry of each effect, -1 if not under it
+	friend class status_effects;
+
 public:
 	mob( simulation &simulation, const path &path, const mob_def &mob_def ) :
 		simulated{simulation},
 		path_{ path },
-		image_{ mob_def.image_name.c_str() },
+		field_{ simulation.get_flow_field() },
+		at_{ path.at( 0 ) },
+		previous_at_{ at_ },
+		rotation_{ path.rotation_at( 0 ) },
+		image_{ image::named( mob_def.image_name, true ) },
 		hp_{ mob_def.hp },
-		speed_{ mob_def.speed },
+		base_speed_{ scalar( mob_def.speed ) },
+		speed_{ base_speed_ },
 		damage_{ mob_def.damage }
 	{
+		for (auto &s:effect_slots_)
+			s = -1;
+			//	Walled in from the start: keeps to the lane
+		if (field_ && !field_->is_reachable( at_ ))
+			field_ = nullptr;
 	}
 
-	void render()
+	sprite get_sprite() const
 	{
-		image_.render( path_.at( position_ ), path_.rotation_at( position_ ) );
+		return { &image_, previous_at_, at_, rotation_ };
+	}
+
+	///	One lookup per pixel walked
+	void step_field()
+	{
+		previous_at_ = at_;
+		auto new_position = position_ + speed_;
+		for (auto n=(int)new_position-(int)position_;n>0;n--)
+		{
+			auto direction = field_->direction( at_ );
+			if (direction==flow_field::kNone)
+				break;		//	An obstacle appeared under the mob: waits for the way to open
+			rotation_ = direction;
+			at_ = flow_field::next( at_, direction );
+			if (field_->is_goal( at_ ))
+			{
+				simulation_.emit( sim_event::kBaseDamage, at_ );
+				simulation_.damage_base( damage_ );
+				simulation_.destroy_mob( this );
+				return;
+			}
+		}
+		position_ = new_position;
 	}
 
 	void step()
 	{
+		if (field_)
+		{
+			step_field();
+			return;
+		}
+
+		previous_at_ = at_;
 		auto new_position = position_ + speed_;
 
 		if (!path_.contains(new_position))
 		{
+			simulation_.emit( sim_event::kBaseDamage, at_ );
 			simulation_.damage_base( damage_ );
 			simulation_.destroy_mob( this );
 		}
 		else
+		{
 			position_ = new_position;
+			at_ = path_.at( position_, cursor_ );
+			rotation_ = path_.rotation_at( position_, cursor_ );
+		}
 	}
 
-	point location() const { return path_.at( position_ ); }
+	handle get_handle() const { return handle_; }
+
+	point location() const { return at_; }
+
+	///	The lane the mob walks on, nullptr if it follows a flow field
+	const path *lane() const { return field_?nullptr:&path_; }
+
+	///	Distance walked
+	scalar position() const { return position_; }
 
 	void damage( size_t damage )
 	{
 		if (hp_>damage)
 		{
 			hp_ -= damage;
+			simulation_.emit( sim_event::kHit, at_ );
 			return;
 		}
 
+		simulation_.emit( sim_event::kKill, at_ );
 		simulation_.destroy_mob( this );
 	}
 };
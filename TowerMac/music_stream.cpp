@@ -0,0 +1,167 @@
+//
+//  music_stream.cpp
+//  TowerMac
+//
+
+#include "music_stream.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+	//	WAV files are little endian, whatever the machine
+static uint32_t read_le( const uint8_t *p, size_t bytes )
+{
+	uint32_t v = 0;
+	for (size_t i=bytes;i--;)
+		v = (v<<8)|p[i];
+	return v;
+}
+
+	//	Finds the format and the samples of a RIFF WAVE file, and leaves the file at the first sample
+std::unique_ptr<music_stream> music_stream::open( const std::string &filename, const SDL_AudioSpec &spec )
+{
+	auto file = fopen( filename.c_str(), "rb" );
+	if (!file)
+	{
+		logger::error( logger::kSound, "cannot open music", "file", filename );
+		return nullptr;
+	}
+
+	auto fail = [&]( const char *reason ) -> std::unique_ptr<music_stream>
+	{
+		logger::error( logger::kSound, "cannot play music", "file", filename, "reason", reason );
+		fclose( file );
+		return nullptr;
+	};
+
+	uint8_t header[12];
+	if (fread( header, 1, 12, file )!=12 || memcmp( header, "RIFF", 4 ) || memcmp( header+8, "WAVE", 4 ))
+		return fail( "not a WAV file" );
+
+	SDL_AudioFormat format = 0;
+	uint32_t channels = 0;
+	uint32_t rate = 0;
+	uint32_t block_align = 0;
+	for (;;)
+	{
+		uint8_t chunk[8];
+		if (fread( chunk, 1, 8, file )!=8)
+			return fail( "no samples" );
+		auto size = read_le( chunk+4, 4 );
+		auto skip = size+(size&1);		//	Chunks are padded to even sizes
+
+		if (!memcmp( chunk, "fmt ", 4 ))
+		{
+			uint8_t fmt[40] = {};
+			auto read = std::min( size, (uint32_t)sizeof(fmt) );
+			if (size<16 || fread( fmt, 1, read, file )!=read)
+				return fail( "bad format chunk" );
+			skip -= read;
+			auto tag = read_le( fmt, 2 );
+			channels = read_le( fmt+2, 2 );
+			rate = read_le( fmt+4, 4 );
+			block_align = read_le( fmt+12, 2 );
+			auto bits = read_le( fmt+14, 2 );
+			if (tag==0xfffe && read>=26)
+				tag = read_le( fmt+24, 2 );		//	WAVE_FORMAT_EXTENSIBLE: the real tag starts the sub format
+			if (tag==1 && bits==8)
+				format = AUDIO_U8;
+			else if (tag==1 && bits==16)
+				format = AUDIO_S16LSB;
+			else if (tag==1 && bits==32)
+				format = AUDIO_S32LSB;
+			else if (tag==3 && bits==32)
+				format = AUDIO_F32LSB;
+			else
+				return fail( "unsupported sample format" );
+		}
+		else if (!memcmp( chunk, "data", 4 ))
+		{
+			if (!format || !channels || !block_align)
+				return fail( "samples before the format" );
+			size -= size%block_align;
+			if (!size)
+				return fail( "no samples" );
+			auto stream = SDL_NewAudioStream( format, channels, rate, spec.format, spec.channels, spec.freq );
+			if (!stream)
+				return fail( SDL_GetError() );
+			logger::info( logger::kSound, "streaming music", "file", filename, "freq", rate, "channels", channels, "bytes", size );
+			return std::unique_ptr<music_stream>{ new music_stream( file, ftell( file ), size, block_align, stream ) };
+		}
+
+		if (fseek( file, skip, SEEK_CUR ))
+			return fail( "no samples" );
+	}
+}
+
+music_stream::music_stream( FILE *file, long data_begin, size_t data_size, size_t block_align, SDL_AudioStream *stream ) :
+	file_{ file },
+	data_begin_{ data_begin },
+	data_size_{ data_size },
+	data_left_{ data_size },
+	chunk_size_{ kChunkSize-kChunkSize%block_align },
+	stream_{ stream }
+{
+	thread_ = std::thread{ [this]{ run(); } };
+}
+
+music_stream::~music_stream()
+{
+	quit_ = true;
+	thread_.join();
+	SDL_FreeAudioStream( stream_ );
+	fclose( file_ );
+}
+
+	//	At the end of the samples, goes back to the first one: the conversion stream
+	//	never sees the loop point, so it resamples across it as if the music went on
+bool music_stream::read_chunk()
+{
+	uint8_t chunk[kChunkSize];
+
+	if (!data_left_)
+	{
+		fseek( file_, data_begin_, SEEK_SET );
+		data_left_ = data_size_;
+	}
+
+		//	Whole sample frames only, as data_size_ and chunk_size_ are multiples of the block size
+	auto size = std::min( data_left_, chunk_size_ );
+	if (fread( chunk, 1, size, file_ )!=size)
+	{
+		logger::error( logger::kSound, "cannot read music" );
+		return false;
+	}
+	data_left_ -= size;
+	if (SDL_AudioStreamPut( stream_, chunk, (int)size )<0)
+	{
+		logger::error( logger::kSound, "cannot convert music", "reason", SDL_GetError() );
+		return false;
+	}
+	return true;
+}
+
+void music_stream::run()
+{
+	frame f;
+	while (!quit_)
+	{
+		if (SDL_AudioStreamAvailable( stream_ )<FRAME)
+		{
+			if (!read_chunk())
+				return;
+			continue;
+		}
+
+		SDL_AudioStreamGet( stream_, f.data(), FRAME );
+		while (!ring_.push( f ))
+		{
+			if (quit_)
+				return;
+			int ms = kIdleMs;
+			std::this_thread::sleep_for( std::chrono::milliseconds( ms ) );
+		}
+	}
+}
@@ -0,0 +1,70 @@
+//
+//  music_stream.hpp
+//  TowerMac
+//
+
+#ifndef MUSIC_STREAM_INCLUDED__
+#define MUSIC_STREAM_INCLUDED__
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "SDL2/SDL.h"
+
+#include "lockfree.hpp"
+#include "sound_manager.hpp"
+
+///	A WAV file played in a loop without ever being loaded whole
+///	A background thread reads the file in small chunks, converts them to the audio format,
+///	and keeps a ring of a few frames ahead of the audio callback, which only pops them
+///	The conversion runs across the loop point, so looping has no gap or click
+class music_stream
+{
+public:
+	typedef std::array<uint8_t,FRAME> frame;
+
+private:
+	static const size_t kFrames = 16;			///	In the ring, about a quarter of a second
+	static const size_t kChunkSize = 4096;		///	Bytes read from the file at once
+	static const int kIdleMs = 5;				///	How long the reader sleeps when the ring is full
+
+	FILE *file_;
+	long data_begin_;			///	Where the samples start in the file
+	size_t data_size_;			///	In bytes
+	size_t data_left_;			///	Until the end of the samples, where it loops back
+	size_t chunk_size_;			///	kChunkSize, rounded down to whole sample frames
+
+	SDL_AudioStream *stream_;	///	From the format of the file to the format of the audio device
+	spsc_queue<frame,kFrames> ring_;
+	std::atomic<size_t> underruns_{ 0 };
+
+	std::atomic<bool> quit_{ false };
+	std::thread thread_;
+
+	music_stream( FILE *file, long data_begin, size_t data_size, size_t block_align, SDL_AudioStream *stream );
+
+	///	Reads the next chunk of the file into the conversion stream
+	bool read_chunk();
+	void run();
+
+public:
+	music_stream( const music_stream & ) = delete;
+	~music_stream();
+
+	///	Starts reading the file, converted for the given audio device. Returns nullptr if it cannot be played
+	static std::unique_ptr<music_stream> open( const std::string &filename, const SDL_AudioSpec &spec );
+
+	///	Called by the audio callback. Returns false if the reader fell behind (or is done)
+	bool read( frame &f ) { return ring_.pop( f ); }
+
+	///	Frames the audio callback did not get in time
+	size_t underruns() const { return underruns_.load( std::memory_order_relaxed ); }
+	void count_underrun() { underruns_.fetch_add( 1, std::memory_order_relaxed ); }
+};
+
+#endif
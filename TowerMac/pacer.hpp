@@ -0,0 +1,123 @@
+//
+//  pacer.hpp
+//  TowerMac
+//
+
+#ifndef PACER_INCLUDED__
+#define PACER_INCLUDED__
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "logger.hpp"
+
+///	Paces the game loop: the simulation runs at a fixed rate, the rendering at the display refresh
+///	Each frame runs the simulation ticks that are due, and renders in between the last two ticks
+///	Timing uses the performance counter, and the frame intervals statistics are logged regularly
+class frame_pacer
+{
+	static const size_t kMaxTicksPerFrame = 4;	///	If we are further behind, we drop time instead of spiraling
+	static const size_t kStatsFrames = 256;
+
+	uint64_t frequency_;
+	uint64_t tick_;				///	Duration of a simulation tick, in counter units
+	uint64_t period_;			///	Duration of a display refresh, in counter units
+
+	uint64_t last_ = 0;			///	Start of the previous frame
+	uint64_t accumulator_ = 0;	///	Time not yet simulated
+	uint64_t frame_start_ = 0;
+	uint64_t interval_ = 0;		///	Between the last two frames
+
+	std::vector<uint64_t> intervals_;	///	Between frames, for the statistics
+	size_t missed_ = 0;					///	Frames that took more than a display refresh
+	size_t dropped_ = 0;				///	Ticks skipped because we were too late
+
+public:
+	///	'refresh' is the display refresh rate, in Hz (0 if unknown)
+	frame_pacer( size_t ticks_per_second, int refresh ) :
+		frequency_{ SDL_GetPerformanceFrequency() },
+		tick_{ frequency_/ticks_per_second },
+		period_{ frequency_/(refresh>0?refresh:60) }
+	{
+		intervals_.reserve( kStatsFrames );
+	}
+
+	///	Starts a frame, and returns the number of simulation ticks to run before rendering it
+	size_t begin_frame()
+	{
+		frame_start_ = SDL_GetPerformanceCounter();
+		if (last_)
+		{
+			auto interval = frame_start_-last_;
+			interval_ = interval;
+			accumulator_ += interval;
+			record( interval );
+		}
+		else
+			accumulator_ = tick_;	//	The first frame runs one tick
+		last_ = frame_start_;
+
+		size_t ticks = accumulator_/tick_;
+		accumulator_ -= ticks*tick_;
+		if (ticks>kMaxTicksPerFrame)
+		{
+			dropped_ += ticks-kMaxTicksPerFrame;
+			ticks = kMaxTicksPerFrame;
+		}
+		return ticks;
+	}
+
+	///	How far we are between the last simulation tick and the next one (0 to 1)
+	double alpha() const { return (double)accumulator_/tick_; }
+
+	///	Time between the start of the last two frames, in ms
+	double frame_time() const { return interval_*1000.0/frequency_; }
+
+	///	Duration of a display refresh, in ms: the frame budget
+	double period() const { return period_*1000.0/frequency_; }
+
+	///	Ends the frame. With vsync, the present already waited for the display
+	///	Without it, we wait here, so we do not render more often than the display can show
+	void end_frame()
+	{
+		auto deadline = frame_start_+period_;
+		auto now = SDL_GetPerformanceCounter();
+		if (now>=deadline)
+			return;
+
+		auto ms = (deadline-now)*1000/frequency_;
+		if (ms>1)
+			SDL_Delay( (uint32_t)ms-1 );
+		while (SDL_GetPerformanceCounter()<deadline)
+			;
+	}
+
+private:
+	void record( uint64_t interval )
+	{
+		intervals_.push_back( interval );
+		if (interval>period_+period_/2)
+			missed_++;
+
+		if (intervals_.size()<kStatsFrames)
+			return;
+
+		auto ms = [this]( uint64_t v ) { return v*1000.0/frequency_; };
+		auto p50 = intervals_.begin()+intervals_.size()/2;
+		std::nth_element( intervals_.begin(), p50, intervals_.end() );
+		auto v50 = *p50;
+		auto p99 = intervals_.begin()+intervals_.size()*99/100;
+		std::nth_element( intervals_.begin(), p99, intervals_.end() );
+		auto v99 = *p99;
+
+		logger::info( logger::kPerf, "frames", "p50_ms", ms( v50 ), "p99_ms", ms( v99 ), "missed", missed_, "of", intervals_.size(), "dropped_ticks", dropped_ );
+
+		intervals_.clear();
+		missed_ = 0;
+		dropped_ = 0;
+	}
+};
+
+#endif
@@ -0,0 +1,124 @@
+//
+//  particles.cpp
+//  TowerMac
+//
+
+#include "particles.hpp"
+#include "framebuffer.hpp"
+
+#include <cmath>
+
+#include <SDL2/SDL.h>
+
+extern SDL_Renderer *gRenderer;
+
+namespace
+{
+	const float kDrag = 0.85f;		///	Speed kept from one tick to the next
+
+	///	What each kind of event emits
+	struct burst
+	{
+		int count;
+		float min_speed;
+		float max_speed;
+		float life;			///	In ticks
+		uint8_t r, g, b;
+	};
+
+	const burst kBursts[sim_event::kKindCount] =
+	{
+		{ 4, 0.5f, 1.5f, 6, 255, 224, 64 },		//	kHit: a few yellow sparks
+		{ 16, 0.5f, 3.0f, 14, 255, 128, 32 },	//	kKill: orange debris
+		{ 24, 1.0f, 4.0f, 18, 255, 32, 32 },	//	kBaseDamage: a red splash
+	};
+}
+
+particle_system::particle_system()
+{
+	clear();
+	for (auto &p:points_)
+		p.reserve( kCapacity );
+}
+
+void particle_system::clear()
+{
+	for (size_t i=0;i!=kCapacity;i++)
+	{
+		x_[i] = y_[i] = dx_[i] = dy_[i] = 0;
+		life_[i] = 0;
+		kind_[i] = 0;
+	}
+}
+
+	//	xorshift: the particles do not need anything better, and must not touch the simulation random numbers
+float particle_system::random()
+{
+	seed_ ^= seed_<<13;
+	seed_ ^= seed_>>17;
+	seed_ ^= seed_<<5;
+	return (seed_>>8)*(1.0f/(1<<24));
+}
+
+void particle_system::emit( const sim_event &e )
+{
+	auto &b = kBursts[e.kind];
+	for (int n=0;n!=b.count;n++)
+	{
+		auto angle = random()*6.2831853f;
+		auto speed = b.min_speed+random()*(b.max_speed-b.min_speed);
+		auto i = next_;
+		next_ = (next_+1)%kCapacity;
+		x_[i] = (float)e.location.x;
+		y_[i] = (float)e.location.y;
+		dx_[i] = std::cos( angle )*speed;
+		dy_[i] = std::sin( angle )*speed;
+		life_[i] = b.life*(0.5f+random()*0.5f);
+		kind_[i] = e.kind;
+	}
+}
+
+void particle_system::emit_all( sim_event_queue &events )
+{
+	sim_event e;
+	while (events.pop( e ))
+		emit( e );
+}
+
+	//	No test on life: dead particles move too, which costs less than skipping them
+void particle_system::step()
+{
+	for (size_t i=0;i!=kCapacity;i++)
+	{
+		x_[i] += dx_[i];
+		y_[i] += dy_[i];
+		dx_[i] *= kDrag;
+		dy_[i] *= kDrag;
+		life_[i] -= 1;
+	}
+}
+
+void particle_system::draw()
+{
+	for (auto &p:points_)
+		p.clear();
+	for (size_t i=0;i!=kCapacity;i++)
+		if (life_[i]>0)
+			points_[kind_[i]].push_back( { (int)x_[i], (int)y_[i] } );
+
+	for (int k=0;k!=sim_event::kKindCount;k++)
+	{
+		auto &p = points_[k];
+		if (p.empty())
+			continue;
+		if (framebuffer::screen)
+		{
+			for (auto &pt:p)
+				framebuffer::screen->set_pixel( pt.x, pt.y, true );
+			continue;
+		}
+		auto &b = kBursts[k];
+		SDL_SetRenderDrawColor( gRenderer, b.r, b.g, b.b, 255 );
+		SDL_RenderDrawPoints( gRenderer, p.data(), (int)p.size() );
+	}
+}
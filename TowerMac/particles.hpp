@@ -0,0 +1,59 @@
+//
+//  particles.hpp
+//  TowerMac
+//
+
+#ifndef PARTICLES_INCLUDED__
+#define PARTICLES_INCLUDED__
+
+#include <cstdint>
+#include <vector>
+
+#include "core.hpp"
+#include "sim_event.hpp"
+
+struct SDL_Point;
+
+///	Sparks and debris, only for the eye: the simulation never sees them
+///	Particles are stored as arrays of each field, in a ring: a new particle replaces the oldest one,
+///	so there is never any allocation, and a burst larger than the ring only shortens the older effects
+///	All the particles, dead or alive, are moved in a single loop without branches
+class particle_system
+{
+	static const size_t kCapacity = 4096;
+
+		//	One entry per particle
+	float x_[kCapacity];
+	float y_[kCapacity];
+	float dx_[kCapacity];
+	float dy_[kCapacity];
+	float life_[kCapacity];			///	Ticks left, dead at 0 or below
+	uint8_t kind_[kCapacity];		///	sim_event::eKind that emitted it, which gives its color
+
+	size_t next_ = 0;				///	Slot of the next particle
+	uint32_t seed_ = 0x2545F491;
+
+	std::vector<SDL_Point> points_[sim_event::kKindCount];	///	Reused by draw(), one batch per color
+
+	float random();		///	In [0,1)
+
+public:
+	particle_system();
+	particle_system( const particle_system & ) = delete;
+
+	///	A burst of particles for that event
+	void emit( const sim_event &e );
+
+	///	Emits for every event waiting in the queue
+	void emit_all( sim_event_queue &events );
+
+	///	Moves everything by one tick
+	void step();
+
+	///	One point per live particle, one draw call per color
+	void draw();
+
+	void clear();
+};
+
+#endif
@@ -2,117 +2,289 @@
 #define PATH_INCLUDED__
 
 #include <cassert>
-#include <iostream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
 
 #include "core.hpp"
+#include "logger.hpp"
 
+///	A lane: straight lines and Bezier curves, one after the other
+///	Positions on the path are arc lengths, in pixels from the origin
+///	Only the corners (and the control points of the curves) are stored, with the arc length where
+///	each segment starts. Curves also have a table from arc length to curve parameter
 class path
 {
+	typedef vector2<double> vector2d;
+
+public:
+	///	Where a walker is on the path, so that its next lookup starts from the segment it was on
+	struct cursor
+	{
+		size_t segment = 0;
+	};
+
+private:
+	static const size_t kLutSteps = 32;		///	Arc length table entries per curve (plus one)
+	static const size_t kLutSubsteps = 8;	///	Chords measured between two entries
+
+	struct segment
+	{
+		enum eKind
+		{
+			kLine,
+			kQuadratic,
+			kCubic
+		}	kind;
+		vector2d p[4];		///	Start, control points, end (p[1] is the end of a line, p[2] of a quadratic)
+		double start = 0;	///	Arc length at the start of the segment, set by add()
+		double length = 0;
+		size_t lut = 0;		///	For curves, index in lut_ of the kLutSteps+1 arc lengths, from parameter 0 to 1
+
+		const vector2d &end() const { return p[kind+1]; }
+	};
+
 	const point origin_;
-	std::vector<point> screen_path_;
+	std::vector<segment> segments_;
+	std::vector<double> lut_;
+	double length_ = 0;
 
-	/// From a point and a series of alternating h and v deltas, create a pixel-by-pixel on-screen path
-	std::vector<point> make_screen_path( const point &origin, const std::vector<int> &deltas )
+	vector2d evaluate( const segment &s, double t ) const
 	{
-		std::vector<point> res;
-		point p = origin_;
-		bool vertical = false;
-		res.push_back( p );
-		for (int i=0;i!=deltas.size();i++)
+		auto u = 1-t;
+		switch (s.kind)
 		{
-			assert( deltas[i] );
-			int direction = deltas[i]/abs(deltas[i]);
-			for (int j=0;j!=abs(deltas[i]);j++)
-			{   if (vertical)
-					p.y+=direction;
-				else
-					p.x+=direction;
-				res.push_back( p );
-			}
-			vertical = !vertical;
+			case segment::kLine:
+				return s.p[0]*u+s.p[1]*t;
+			case segment::kQuadratic:
+				return s.p[0]*(u*u)+s.p[1]*(2*u*t)+s.p[2]*(t*t);
+			case segment::kCubic:
+				return s.p[0]*(u*u*u)+s.p[1]*(3*u*u*t)+s.p[2]*(3*u*t*t)+s.p[3]*(t*t*t);
 		}
-		return res;
+		return s.p[0];
 	}
 
-	/// From a s set of corner points, create a pixel-by-pixel on-screen path
-	std::vector<point> make_screen_path( const std::vector<point> &points )
+	vector2d tangent( const segment &s, double t ) const
 	{
-		std::vector<point> res;
-		auto p = points.begin();
-		point pt = *p;
-		res.push_back( pt );
-		while (p!=points.end())
+		auto u = 1-t;
+		switch (s.kind)
 		{
-			while (pt!=*p)
+			case segment::kLine:
+				return s.p[1]-s.p[0];
+			case segment::kQuadratic:
+				return (s.p[1]-s.p[0])*(2*u)+(s.p[2]-s.p[1])*(2*t);
+			case segment::kCubic:
+				return (s.p[1]-s.p[0])*(3*u*u)+(s.p[2]-s.p[1])*(6*u*t)+(s.p[3]-s.p[2])*(3*t*t);
+		}
+		return s.p[1]-s.p[0];
+	}
+
+	///	The curve parameter at a distance from the start of the segment
+	double parameter( const segment &s, double distance ) const
+	{
+		if (s.kind==segment::kLine)
+			return s.length>0?distance/s.length:0;
+
+		auto begin = lut_.begin()+s.lut;
+		auto i = (size_t)(std::upper_bound( begin, begin+kLutSteps+1, distance )-begin);
+		if (i==0)
+			return 0;
+		if (i>kLutSteps)
+			return 1;
+		auto a = begin[i-1];
+		auto b = begin[i];
+		return (i-1+(b>a?(distance-a)/(b-a):0))/kLutSteps;
+	}
+
+	void add( segment s )
+	{
+		s.start = length_;
+		if (s.kind==segment::kLine)
+			s.length = norm( s.p[1]-s.p[0] );
+		else
+		{
+			s.lut = lut_.size();
+			double length = 0;
+			auto previous = s.p[0];
+			lut_.push_back( 0 );
+			for (size_t i=1;i<=kLutSteps*kLutSubsteps;i++)
 			{
-				if (pt.x<p->x)
-					pt.x++;
-				else if (pt.x>p->x)
-					pt.x--;
-				else
-					if (pt.y<p->y)
-						pt.y++;
-					else
-						pt.y--;
-				res.push_back( pt );
+				auto p = evaluate( s, (double)i/(kLutSteps*kLutSubsteps) );
+				length += norm( p-previous );
+				previous = p;
+				if (i%kLutSubsteps==0)
+					lut_.push_back( length );
 			}
-			p++;
+			s.length = length;
 		}
-		return res;
+		if (s.length==0)
+		{
+			if (s.kind!=segment::kLine)
+				lut_.resize( s.lut );
+			return;		//	Repeated point
+		}
+		length_ += s.length;
+		segments_.push_back( s );
+	}
+
+	vector2d last() const { return segments_.empty()?vector2d{ origin_ }:segments_.back().end(); }
+
+	///	The segment that contains that distance: its end included, its start excluded (except for the first one)
+	///	So at a corner, the walker is still on the segment that brought it there
+	size_t find( double distance, cursor &c ) const
+	{
+		auto i = std::min( c.segment, segments_.size()-1 );
+		while (i+1<segments_.size() && distance>segments_[i].start+segments_[i].length)
+			i++;
+		while (i>0 && distance<=segments_[i].start)
+			i--;
+		c.segment = i;
+		return i;
+	}
+
+	size_t find( double distance ) const
+	{
+		auto s = std::upper_bound( segments_.begin(), segments_.end(), distance, []( double d, const segment &s ) { return d<=s.start; } );
+		return s==segments_.begin()?0:s-segments_.begin()-1;
+	}
+
+	///	The pixels are at whole distances from the origin
+	static double whole( scalar position ) { return std::floor( (double)position ); }
+
+	vector2d exact( double distance, size_t segment ) const
+	{
+		if (segments_.empty())
+			return vector2d{ origin_ };
+		auto &s = segments_[segment];
+		return evaluate( s, parameter( s, std::min( std::max( distance-s.start, 0.0 ), s.length ) ) );
+	}
+
+	static point pixel( const vector2d &v ) { return { (size_t)std::lround( v.x ), (size_t)std::lround( v.y ) }; }
+
+	///	0 to 3 rotation of a sprite moving along that direction (down, left, up, right)
+	static int rotation( const vector2d &d )
+	{
+		if (std::abs( d.x )>=std::abs( d.y ) && d.x!=0)
+			return d.x<0?1:3;
+		return d.y<0?2:0;
+	}
+
+	int rotation( double distance, size_t segment ) const
+	{
+		if (segments_.empty())
+			return 0;
+		auto &s = segments_[segment];
+		return rotation( tangent( s, parameter( s, std::min( std::max( distance-s.start, 0.0 ), s.length ) ) ) );
 	}
 
 public:
-	path( const point &origin, const std::vector<int> &deltas ) :
-		origin_{ origin },
-		screen_path_{ make_screen_path( origin_, deltas ) }
-		{}
+	///	Starts a path, to be continued with line_to(), quadratic_to() and cubic_to()
+	explicit path( const point &origin ) : origin_{ origin } {}
+
+	/// From a point and a series of alternating h and v deltas
+	path( const point &origin, const std::vector<int> &deltas ) : origin_{ origin }
+	{
+		auto p = origin;
+		bool vertical = false;
+		for (auto d:deltas)
+		{
+			assert( d );
+			if (vertical)
+				p.y += d;
+			else
+				p.x += d;
+			line_to( p );
+			vertical = !vertical;
+		}
+	}
 
-	path( const std::vector<point> &points ) :
-		origin_{ points[0] },
-		screen_path_{ make_screen_path( points ) }
-		{}
+	/// From a set of corner points
+	path( const std::vector<point> &points ) : origin_{ points[0] }
+	{
+		for (auto &p:points)
+			line_to( p );
+	}
 
-//    path offset( int dx, int dy )
-//    {
-//        return { { origin_.x+dx, origin_.y+dy }, deltas_ };
-//    }
+	path &line_to( const point &p )
+	{
+		add( { segment::kLine, { last(), vector2d{ p } } } );
+		return *this;
+	}
 
-	bool contains( float position ) const
+	path &quadratic_to( const point &control, const point &p )
 	{
-		return position>=0 && (int)position<screen_path_.size();
+		add( { segment::kQuadratic, { last(), vector2d{ control }, vector2d{ p } } } );
+		return *this;
 	}
 
-	point at( float position ) const
+	path &cubic_to( const point &control1, const point &control2, const point &p )
+	{
+		add( { segment::kCubic, { last(), vector2d{ control1 }, vector2d{ control2 }, vector2d{ p } } } );
+		return *this;
+	}
+
+	///	Total arc length
+	double length() const { return length_; }
+
+	bool contains( scalar position ) const
+	{
+		return position>=0 && whole( position )<=length_;
+	}
+
+	///	The pixel at that position (as if the path was walked pixel by pixel)
+	point at( scalar position ) const
 	{
 		assert( contains( position ) );
-		return screen_path_[(int)position];
+		auto d = whole( position );
+		return pixel( exact( d, find( d ) ) );
 	}
 
-	const std::vector<point> get_points() const { return screen_path_; }
+	///	Same, starting the search from where the cursor is (O(1) when walking the path)
+	point at( scalar position, cursor &c ) const
+	{
+		assert( contains( position ) );
+		auto d = whole( position );
+		return pixel( exact( d, find( d, c ) ) );
+	}
+
+	///	The exact location at that position, between pixels
+	vector2f exact_at( scalar position, cursor &c ) const
+	{
+		auto d = std::min( std::max( (double)position, 0.0 ), length_ );
+		auto v = exact( d, find( d, c ) );
+		return { scalar( v.x ), scalar( v.y ) };
+	}
 
 	/// 0 to 3 rotation
-	int rotation_at( float position ) const
+	int rotation_at( scalar position ) const
 	{
-		if (position==0)
-			position = 1;
-		auto dx = screen_path_[position].x-screen_path_[position-1].x;
-		if (dx==-1)
-			return 1;
-		if (dx==1)
-			return 3;
+		auto d = whole( position );
+		return rotation( d, find( d ) );
+	}
 
-		auto dy = screen_path_[position].y-screen_path_[position-1].y;
-		if (dy==-1)
-			return 2;
+	int rotation_at( scalar position, cursor &c ) const
+	{
+		auto d = whole( position );
+		return rotation( d, find( d, c ) );
+	}
 
-		return 0;
+	///	The pixels at whole positions from begin to end (included), for drawing the path
+	std::vector<point> pixels( size_t begin, size_t end ) const
+	{
+		std::vector<point> res;
+		cursor c;
+		for (auto d=begin;d<=end && d<=length_;d++)
+			res.push_back( at( scalar( (double)d ), c ) );
+		return res;
 	}
 
+	std::vector<point> pixels() const { return pixels( 0, (size_t)length_ ); }
+
 	void dump()
 	{
-		for (auto &p:screen_path_)
-			std::clog << p.x << "," << p.y << " ";
-		std::clog << "\n";
+		logger::debug( logger::kDefinitions, "path", "x", origin_.x, "y", origin_.y, "length", length_ );
+		for (auto &s:segments_)
+			logger::debug( logger::kDefinitions, "segment", "kind", s.kind, "x", s.end().x, "y", s.end().y );
 	}
 
 };
@@ -0,0 +1,159 @@
+//
+//  perf_hud.hpp
+//  TowerMac
+//
+
+#ifndef PERF_HUD_INCLUDED__
+#define PERF_HUD_INCLUDED__
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+#include "ui.hpp"
+
+///	What the HUD shows, gathered once per frame by the game loop
+struct perf_sample
+{
+	double frame_time = 0;		///	ms, between the last two frames
+	double tick_time = 0;		///	ms, last simulation tick
+	double render_time = 0;		///	ms, drawing the views of the previous frame
+	double audio_time = 0;		///	ms, last audio callback
+	size_t mobs = 0;
+	size_t bullets = 0;
+	size_t arena_objects = 0;	///	Live entities in the simulation arena (shown as objects/blocks)
+	size_t arena_blocks = 0;
+};
+
+///	Live performance numbers, drawn over the game
+///	The labels are laid out once; only the digits are formatted again, a few times per second
+///	Below them, a sparkline of the last frame times, with a dotted line at the frame budget
+class perf_hud : public view
+{
+	static const size_t kHistory = 128;			///	Frames in the sparkline
+	static const size_t kRefreshFrames = 8;		///	Digits are formatted again every that many frames
+	static const size_t kLineHeight = 9;
+	static const size_t kGraphHeight = 24;		///	Two frame budgets
+	static const size_t kWidth = kHistory+6;
+
+	enum eField { kFPS, kFrame, kTick, kRender, kAudio, kMobs, kBullets, kArena, kFieldCount };
+
+	struct field
+	{
+		line label;				///	Laid out once
+		char digits[24] = "";
+		size_t length = 0;
+		size_t digits_x = 0;	///	Right aligned, computed when the digits change
+	};
+	field fields_[kFieldCount];
+
+	double budget_;				///	ms
+	float history_[kHistory] = {};
+	size_t next_ = 0;			///	Oldest entry in history_
+	size_t frames_ = 0;
+	perf_sample sample_;
+
+	static line lay_out( const char *label )
+	{
+		std::vector<token> tokens;
+		tokenize( tokens, styled_string{ label, font::normal.get(), false } );
+		for (auto &word:tokens)
+		{
+			for (auto &l:word.letters)
+				l.spacing = 1;
+			word.letters.back().spacing = 4;
+		}
+		return tokens;
+	}
+
+	void set_digits( eField f, const char *format, ... )
+	{
+		auto &d = fields_[f];
+		va_list args;
+		va_start( args, format );
+		auto n = vsnprintf( d.digits, sizeof(d.digits), format, args );
+		va_end( args );
+		d.length = std::min( (size_t)std::max( n, 0 ), sizeof(d.digits)-1 );
+
+		size_t w = 0;
+		for (size_t i=0;i!=d.length;i++)
+			w += font::normal->widthof( d.digits[i] )+1;
+		d.digits_x = bounds_.s.w-3-w;
+	}
+
+	///	Formats the averages of the last kRefreshFrames frames
+	void refresh()
+	{
+		double total = 0;
+		for (size_t i=0;i!=kRefreshFrames;i++)
+			total += history_[(next_+kHistory-1-i)%kHistory];
+		auto mean = total/kRefreshFrames;
+
+		set_digits( kFPS, "%.0f", mean>0?1000/mean:0 );
+		set_digits( kFrame, "%.1f", mean );
+		set_digits( kTick, "%.2f", sample_.tick_time );
+		set_digits( kRender, "%.2f", sample_.render_time );
+		set_digits( kAudio, "%.3f", sample_.audio_time );
+		set_digits( kMobs, "%zu", sample_.mobs );
+		set_digits( kBullets, "%zu", sample_.bullets );
+		set_digits( kArena, "%zu/%zu", sample_.arena_objects, sample_.arena_blocks );
+	}
+
+public:
+	///	'budget' is the time of a display refresh, in ms
+	explicit perf_hud( double budget ) :
+		view{ size{ kWidth, kFieldCount*kLineHeight+kGraphHeight+4 } },
+		budget_{ budget }
+	{
+		set_opaque( true );
+		const char *labels[kFieldCount] = { "fps", "frame ms", "tick ms", "render ms", "audio ms", "mobs", "bullets", "arena" };
+		for (int i=0;i!=kFieldCount;i++)
+			fields_[i].label = lay_out( labels[i] );
+	}
+
+	void toggle() { set_hidden( !is_hidden() ); }
+
+	///	Called every frame, even when hidden, so the sparkline is complete when shown
+	void add_sample( const perf_sample &sample )
+	{
+		sample_ = sample;
+		history_[next_] = (float)sample.frame_time;
+		next_ = (next_+1)%kHistory;
+		if (++frames_%kRefreshFrames==0 && !is_hidden())
+			refresh();
+	}
+
+	virtual void draw_self( graphics &g )
+	{
+		view::draw_self( g );
+
+		g.set_font( font::normal.get() );
+		for (size_t i=0;i!=kFieldCount;i++)
+		{
+			auto &f = fields_[i];
+			g.move_to( { 3, i*kLineHeight+1 } );
+			g.draw_text( f.label );
+			g.move_to( { f.digits_x, i*kLineHeight+1 } );
+			g.draw_text( f.digits, f.length, false );
+		}
+
+			//	One column per frame, oldest on the left, clipped at two budgets
+			//	The budget is dotted across, in white over the columns that exceed it
+		auto bottom = bounds_.s.h-2;
+		auto budget_y = bottom-kGraphHeight/2;
+		for (size_t i=0;i!=kHistory;i++)
+		{
+			auto h = (size_t)std::min( history_[(next_+i)%kHistory]*kGraphHeight/(2*budget_), (double)kGraphHeight );
+			g.set_fill( graphics::kBlack );
+			if (h)
+				g.fill_rect( rect{ { 3+i, bottom-h }, { 1, h } } );
+			if (i%4==0)
+			{
+				g.set_fill( h>=kGraphHeight/2?graphics::kWhite:graphics::kBlack );
+				g.fill_rect( rect{ { 3+i, budget_y }, { 1, 1 } } );
+			}
+		}
+	}
+};
+
+#endif
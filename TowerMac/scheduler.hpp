@@ -0,0 +1,200 @@
+//
+//  scheduler.hpp
+//  TowerMac
+//
+
+#ifndef SCHEDULER_INCLUDED__
+#define SCHEDULER_INCLUDED__
+
+#include <vector>
+#include <cstdint>
+
+#include "simulation.hpp"
+#include "game_def.hpp"
+#include "mob.hpp"
+#include "alloc_profiler.hpp"
+
+///	Schedules the mob spawns of a wave
+///	Events are only (tick, lane, mob_def), the mob itself is created on the tick it spawns
+///	Events are kept in a hierarchical timing wheel: kLevels levels of kSlots slots each
+///	Level 0 has one slot per tick, level n one slot per kSlots^n ticks. Slots are cascaded
+///	down one level each time the level below wraps, so adding and firing an event is O(1)
+class mob_scheduler
+{
+	static const size_t kSlotBits = 6;
+	static const size_t kSlots = 1<<kSlotBits;
+	static const size_t kSlotMask = kSlots-1;
+	static const size_t kLevels = 4;		///	Covers 2^24 ticks, anything later waits in overflow_
+
+	static const uint32_t kNone = UINT32_MAX;
+
+	/// A mob creation at a certain timestamp on a certain lane
+	struct spawn_event
+	{
+		size_t timestamp;
+		const path *lane;
+		const mob_def *def;
+		uint32_t next;			///	Next event in the same slot (or in the free list)
+	};
+
+	std::vector<spawn_event> events_;		///	Storage for all events, linked by index
+	uint32_t free_ = kNone;					///	Head of the list of reusable events
+
+	uint32_t wheel_[kLevels][kSlots];		///	Heads of the slot lists
+	uint32_t overflow_ = kNone;				///	Events too far in the future for the wheel
+
+	size_t now_ = 0;						///	Next timestamp to be processed
+	size_t pending_ = 0;					///	Number of events not spawned yet
+
+	uint32_t allocate( size_t ts, const path *lane, const mob_def *def )
+	{
+		if (free_!=kNone)
+		{
+			auto index = free_;
+			free_ = events_[index].next;
+			events_[index] = { ts, lane, def, kNone };
+			return index;
+		}
+		events_.push_back( { ts, lane, def, kNone } );
+		return (uint32_t)(events_.size()-1);
+	}
+
+	void release( uint32_t index )
+	{
+		events_[index].next = free_;
+		free_ = index;
+	}
+
+	///	Links the event in the slot of the lowest level that shares all higher digits with now_
+	void insert( uint32_t index )
+	{
+		auto &e = events_[index];
+		if (e.timestamp<now_)
+			e.timestamp = now_;		//	Late events spawn right away
+
+		for (size_t level=0;level!=kLevels;level++)
+		{
+			auto shift = kSlotBits*(level+1);
+			if ((e.timestamp>>shift)==(now_>>shift))
+			{
+				auto &slot = wheel_[level][(e.timestamp>>(kSlotBits*level))&kSlotMask];
+				e.next = slot;
+				slot = index;
+				return;
+			}
+		}
+
+		e.next = overflow_;
+		overflow_ = index;
+	}
+
+	///	Re-inserts all events of a list, relative to the current now_
+	void cascade( uint32_t &head )
+	{
+		auto index = head;
+		head = kNone;
+		while (index!=kNone)
+		{
+			auto next = events_[index].next;
+			insert( index );
+			index = next;
+		}
+	}
+
+	///	Processes the events of timestamp now_, and moves to the next one
+	void tick( simulation &simulation )
+	{
+			//	Find the highest level that wrapped and bring its current slot down, top to bottom
+		if ((now_&kSlotMask)==0 && now_!=0)
+		{
+			size_t top = 1;
+			while (top!=kLevels && ((now_>>(kSlotBits*top))&kSlotMask)==0)
+				top++;
+			if (top==kLevels)
+				cascade( overflow_ );
+			for (auto level=std::min(top,kLevels-1);level!=0;level--)
+				cascade( wheel_[level][(now_>>(kSlotBits*level))&kSlotMask] );
+		}
+
+		auto &slot = wheel_[0][now_&kSlotMask];
+		auto index = slot;
+		slot = kNone;
+		while (index!=kNone)
+		{
+			auto &e = events_[index];
+			auto next = e.next;
+			assert( e.timestamp==now_ );
+			simulation.register_mob( simulation.get_arena().create<mob>( simulation, *e.lane, *e.def ) );
+			release( index );
+			pending_--;
+			index = next;
+		}
+
+		now_++;
+	}
+
+public:
+	mob_scheduler()
+	{
+		for (auto &level:wheel_)
+			for (auto &slot:level)
+				slot = kNone;
+	}
+
+	///	Schedules a mob to appear at timestamp ts on the lane
+	void add_event( size_t ts, const path *lane, const mob_def *def )
+	{
+		insert( allocate( ts, lane, def ) );
+		pending_++;
+	}
+
+	///	Reserve storage for a number of events
+	void reserve( size_t count ) { events_.reserve( count ); }
+
+	bool empty() const { return pending_==0; }
+	size_t pending() const { return pending_; }
+
+	///	Spawns all the mobs up to (and including) the simulation timestamp
+	bool step( simulation &simulation )
+	{
+		if (empty())
+			return false;
+		alloc_profiler::enter( alloc_profiler::kSpawns );
+		auto ts = simulation.timestamp();
+		while (now_<=ts && !empty())
+			tick( simulation );
+		alloc_profiler::enter( alloc_profiler::kOther );
+		return true;
+	}
+};
+
+inline mob_scheduler schedule_wave( const wave_def &wave )
+{
+	mob_scheduler sched;
+	size_t ts;
+
+	size_t count = 0;
+	for (auto &wl:wave.wavelets)
+		for (auto &mg:wl.mob_groups)
+			count += mg.count;
+	sched.reserve( count );
+
+	for (auto &wl:wave.wavelets)
+	{
+		ts = 0;
+		for (auto &mg:wl.mob_groups)
+		{
+			ts += mg.spawn_delay;
+			for (size_t i=0;i!=mg.count;i++)
+			{
+				ts += mg.spawn_rate;
+				sched.add_event( ts, wl.path_, mg.mob_def_ );
+			}
+			ts -= mg.spawn_rate;
+		}
+	}
+
+	return sched;
+}
+
+#endif
@@ -0,0 +1,30 @@
+//
+//  sim_event.hpp
+//  TowerMac
+//
+
+#ifndef SIM_EVENT_INCLUDED__
+#define SIM_EVENT_INCLUDED__
+
+#include <cstdint>
+
+#include "core.hpp"
+#include "lockfree.hpp"
+
+///	Something that happened during a tick, for the visual effects
+struct sim_event
+{
+	enum eKind : uint8_t
+	{
+		kHit,			///	A bullet damaged a mob
+		kKill,
+		kBaseDamage,
+		kKindCount
+	}	kind;
+	point location;
+};
+
+///	From the simulation thread to the main thread. Events are dropped when it is full
+typedef spsc_queue<sim_event,1024> sim_event_queue;
+
+#endif
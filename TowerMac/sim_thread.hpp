@@ -0,0 +1,227 @@
+//
+//  sim_thread.hpp
+//  TowerMac
+//
+
+#ifndef SIM_THREAD_INCLUDED__
+#define SIM_THREAD_INCLUDED__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "lockfree.hpp"
+#include "thread_pool.hpp"
+#include "simulation.hpp"
+#include "tower.hpp"
+#include "mob.hpp"
+#include "bullet.hpp"
+#include "scheduler.hpp"
+#include "game_def.hpp"
+
+///	What the renderer needs from one simulation tick
+///	Built by the simulation thread, never modified once published
+struct render_snapshot
+{
+	size_t wave = 0;			///	Which run of the simulation this comes from (0 for none)
+	size_t timestamp = 0;
+	bool game_over = false;
+	bool finished = false;		///	No more mobs to spawn, and none alive
+
+		//	For the performance HUD
+	double tick_time = 0;		///	Of the tick that produced this snapshot, in ms
+	size_t arena_objects = 0;
+	size_t arena_blocks = 0;
+
+	sprite base;
+	std::vector<sprite> towers;
+	std::vector<sprite> mobs;
+	std::vector<sprite> bullets;
+
+	void capture( const simulation &simulation, const mob_scheduler &scheduler, size_t wave_id )
+	{
+		wave = wave_id;
+		timestamp = simulation.timestamp();
+		game_over = simulation.game_over();
+		finished = scheduler.empty() && !simulation.has_mobs();
+		arena_objects = simulation.get_arena().allocated();
+		arena_blocks = simulation.get_arena().blocks();
+
+		base = simulation.get_base().get_sprite();
+
+		towers.clear();
+		for (auto t:simulation.get_towers())
+			towers.push_back( t->get_sprite() );
+
+		mobs.clear();
+		for (auto m=simulation.get_mobs()->begin();m!=simulation.get_mobs()->end();m=m->next())
+			mobs.push_back( m->get_sprite() );
+
+		bullets.clear();
+		for (auto b=simulation.get_bullets()->begin();b!=simulation.get_bullets()->end();b=b->next())
+			bullets.push_back( b->get_sprite() );
+	}
+};
+
+///	Runs the simulation ticks on a worker thread, while the main thread renders the previous one
+///	The main thread owns the simulation, and lends it between start() and stop()
+///	Commands (ticks, input) go through a queue, snapshots come back through a triple buffer
+class sim_thread
+{
+	struct command
+	{
+		enum eKind { kStart, kTick, kTarget, kStop, kQuit } kind = kTick;
+		simulation *sim = nullptr;
+		mob_scheduler *scheduler = nullptr;
+		size_t wave = 0;
+		point target;
+	};
+
+	spsc_queue<command,256> commands_;
+	triple_buffer<render_snapshot> snapshots_;
+
+		//	Only used to sleep when there is nothing to do
+	std::mutex mutex_;
+	std::condition_variable wakeup_;
+
+	thread_pool pool_{ std::max( std::thread::hardware_concurrency(), 2u )-1 };	///	Leaves a core to the renderer
+
+	size_t wave_ = 0;					///	Main thread: the run in progress
+	std::atomic<size_t> stopped_{ 0 };	///	The last run the worker let go of
+
+	std::thread thread_;
+
+	void send( const command &c )
+	{
+		while (!commands_.push( c ))
+			std::this_thread::yield();
+		{ std::lock_guard<std::mutex> guard( mutex_ ); }
+		wakeup_.notify_one();
+	}
+
+	void run()
+	{
+		simulation *sim = nullptr;
+		mob_scheduler *scheduler = nullptr;
+		size_t wave = 0;
+		point target{ 128, 128 };
+
+		auto publish = [&]( double tick_time )
+		{
+			snapshots_.back().capture( *sim, *scheduler, wave );
+			snapshots_.back().tick_time = tick_time;
+			snapshots_.publish();
+		};
+
+		for (;;)
+		{
+			command c;
+			if (!commands_.pop( c ))
+			{
+				std::unique_lock<std::mutex> lock( mutex_ );
+				wakeup_.wait( lock, [&]{ return !commands_.empty(); } );
+				continue;
+			}
+
+			switch (c.kind)
+			{
+				case command::kStart:
+					sim = c.sim;
+					scheduler = c.scheduler;
+					wave = c.wave;
+					publish( 0 );
+					break;
+				case command::kTarget:
+					target = c.target;
+					break;
+				case command::kTick:
+					if (sim)
+					{
+						auto start = std::chrono::steady_clock::now();
+						sim->set_target( target );
+						scheduler->step( *sim );
+						sim->step();
+						publish( std::chrono::duration<double,std::milli>( std::chrono::steady_clock::now()-start ).count() );
+					}
+					break;
+				case command::kStop:
+					sim = nullptr;
+					scheduler = nullptr;
+					stopped_.store( c.wave, std::memory_order_release );
+					break;
+				case command::kQuit:
+					return;
+			}
+		}
+	}
+
+public:
+	sim_thread() : thread_{ [this]{ run(); } } {}
+
+	~sim_thread()
+	{
+		command c;
+		c.kind = command::kQuit;
+		send( c );
+		thread_.join();
+	}
+
+	///	Images must be created on the main thread: loads everything the simulation may spawn
+	static void preload_images()
+	{
+		bullet::default_image();
+		for (auto &w:game_def::spec.wave_defs())
+			for (auto &wl:w.wavelets)
+				for (auto &g:wl.mob_groups)
+					image::named( g.mob_def_->image_name, true );
+	}
+
+	///	Lends the simulation and its scheduler to the thread, until stop()
+	void start( simulation &sim, mob_scheduler &scheduler )
+	{
+		command c;
+		sim.set_thread_pool( &pool_ );
+		c.kind = command::kStart;
+		c.sim = &sim;
+		c.scheduler = &scheduler;
+		c.wave = ++wave_;
+		send( c );
+	}
+
+	void tick()
+	{
+		command c;
+		c.kind = command::kTick;
+		send( c );
+	}
+
+	void set_target( const point &target )
+	{
+		command c;
+		c.kind = command::kTarget;
+		c.target = target;
+		send( c );
+	}
+
+	///	Takes the simulation back: waits until the thread does not use it anymore
+	void stop()
+	{
+		command c;
+		c.kind = command::kStop;
+		c.wave = wave_;
+		send( c );
+		while (stopped_.load( std::memory_order_acquire )!=wave_)
+			std::this_thread::yield();
+	}
+
+	///	The current run, to recognize its snapshots
+	size_t wave() const { return wave_; }
+
+	///	The last snapshot published by the simulation thread
+	const render_snapshot &snapshot() { return snapshots_.front(); }
+};
+
+#endif
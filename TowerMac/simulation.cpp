@@ -3,46 +3,163 @@
 #include "tower.hpp"
 #include "mob.hpp"
 #include "bullet.hpp"
+#include "thread_pool.hpp"
+#include "alloc_profiler.hpp"
+#include "logger.hpp"
 
+///	Towers belong to the game setup, and are deleted one by one
+///	Mobs and bullets are not destroyed: the arena releases their memory in one go
 simulation::~simulation()
 {
 	for (auto &t:towers_)
 		delete t;
-	while (!mobs_.is_empty())
-		mobs_.begin()->remove();
-	while (!bullets_.is_empty())
-		bullets_.begin()->remove();
 }
 
 void simulation::step()
 {
-	for (auto t:towers_)
-		t->step();
-	for (auto m=mobs_.begin();m!=mobs_.end();m=m->next_)
-		m->step();
-	for (auto b=bullets_.begin();b!=bullets_.end();b=b->next_)
-		b->step();
+	alloc_profiler::enter( alloc_profiler::kTowers );
+	fire_towers();
 
+	alloc_profiler::enter( alloc_profiler::kMobs );
+	{
+		alloc_profiler::no_alloc section;
+		effects_.step();
+		for (auto m=mobs_.begin();m!=mobs_.end();m=m->next())
+			m->step();
+	}
+
+	alloc_profiler::enter( alloc_profiler::kTargets );
+	targets_.clear();
+	for (auto m=mobs_.begin();m!=mobs_.end();m=m->next())
+		targets_.push_back( { m->location(), m->get_handle() } );
+
+	alloc_profiler::enter( alloc_profiler::kBullets );
+	step_bullets();
+
+	alloc_profiler::enter( alloc_profiler::kCleanup );
 	for (auto m:dead_mobs_)
-		delete m;
+		arena_.destroy( m );
 	dead_mobs_.clear();
 	for (auto b:dead_bullets_)
-		delete b;
+		arena_.destroy( b );
 	dead_bullets_.clear();
 
+	alloc_profiler::enter( alloc_profiler::kOther );
+	alloc_profiler::end_tick();
+
 	timestamp_++;
 }
 
-tower *simulation::create_tower( const point &location )
+///	Bullets first update in parallel, without changing anything outside of themselves
+///	Then, in list order, each one damages the first mob still alive on its way, or moves
+///	New bullets are added last, at the head of the list, which is where a serial update would put them
+void simulation::step_bullets()
+{
+	stepping_.clear();
+	for (auto b=bullets_.begin();b!=bullets_.end();b=b->next())
+		stepping_.push_back( b );
+	if (stepping_.empty())
+		return;
+
+	size_t chunks = (stepping_.size()+bullet_chunk_-1)/bullet_chunk_;
+	if (commands_.size()<chunks)
+		commands_.resize( chunks );
+
+	auto update = [&]( size_t chunk )
+	{
+		alloc_profiler::enter( alloc_profiler::kBullets );		//	The pool threads count in the phase of the tick too
+		auto &out = commands_[chunk];
+		out.clear();
+		size_t end = std::min( (chunk+1)*bullet_chunk_, stepping_.size() );
+		for (size_t i=chunk*bullet_chunk_;i!=end;i++)
+			stepping_[i]->update( i, out );
+	};
+	if (pool_)
+		pool_->run( chunks, update );
+	else
+		for (size_t c=0;c!=chunks;c++)
+			update( c );
+
+	for (size_t c=0;c!=chunks;c++)
+	{
+		auto &out = commands_[c];
+		auto h = out.hits.begin();
+		size_t end = std::min( (c+1)*bullet_chunk_, stepping_.size() );
+		for (size_t i=c*bullet_chunk_;i!=end;i++)
+		{
+			mob *hit = nullptr;
+			for (;h!=out.hits.end() && h->bullet==i;h++)
+				if (!hit)
+					hit = mob_handles_.get( targets_[h->target].m );
+			stepping_[i]->resolve( hit );
+		}
+	}
+
+	for (size_t c=0;c!=chunks;c++)
+		for (auto b:commands_[c].spawned)
+			register_bullet( b );
+}
+
+void simulation::fire_towers()
 {
-	auto t = new basic_tower( *this, location );
+	firing_towers_.clear();
+	while (!tower_events_.empty() && tower_events_.top().timestamp<=timestamp_)
+	{
+		auto e = tower_events_.top();
+		tower_events_.pop();
+		if (e.t->generation_==e.generation)
+			firing_towers_.push_back( e.t );
+	}
+	if (firing_towers_.empty())
+		return;
+
+	std::stable_sort( std::begin(firing_towers_), std::end(firing_towers_), []( const tower *a, const tower *b ) { return a->kind()<b->kind(); } );
+	index_mobs();
+
+	for (auto t:firing_towers_)
+	{
+		t->charge_from( timestamp_+1 );
+		schedule_tower( t );
+	}
+
+	auto begin = firing_towers_.data();
+	auto end = begin+firing_towers_.size();
+	while (begin!=end)
+	{
+		auto batch_end = begin;
+		while (batch_end!=end && (*batch_end)->kind()==(*begin)->kind())
+			batch_end++;
+		(*begin)->do_effects( begin, batch_end );
+		begin = batch_end;
+	}
+}
+
+tower *simulation::create_tower( const point &location, const tower_stats &stats, const coverage *coverage )
+{
+	auto t = new basic_tower( *this, location, stats, coverage );
+	t->order_ = towers_.size();
 	towers_.push_back( t );
+	schedule_tower( t );
 	return t;
 }
 
+void simulation::schedule_tower( tower *t )
+{
+	tower_events_.push( { t->next_fire_, t->order_, ++t->generation_, t } );
+}
+
 void simulation::register_mob( mob *m )
 {
+	m->handle_ = mob_handles_.insert( m );
 	mobs_.add( m );
+	if (++live_mobs_>dead_mobs_.capacity())
+		dead_mobs_.reserve( 2*live_mobs_ );
+}
+
+void simulation::register_bullet( bullet *b )
+{
+	b->handle_ = bullet_handles_.insert( b );
+	bullets_.add( b );
 }
 
 bool simulation::has_towers()
@@ -50,71 +167,161 @@ bool simulation::has_towers()
 	return !towers_.empty();
 }
 
-void simulation::create_bullet( const point &location, double speed )
+void simulation::play_fire_sound()
 {
 	sound_manager::sm.play_foreground( snd_bullet_, 9 );
+}
 
-	auto b = new bullet( *this, location, normalize( (vector2f)target_-(vector2f)location )*speed );
-//    b->add_modifier( new drunken_modifier() );
-	b->add_modifier( new splitting_modifier() );
+void simulation::create_bullet( const point &location, const point &aim, double speed, size_t damage, uint32_t modifiers )
+{
+		//	Aiming at the tower itself (like a click right on it) gives no direction: nothing to fire
+	if (aim.x==location.x && aim.y==location.y)
+		return;
+	auto b = arena_.create<bullet>( *this, location, normalize( (vector2f)aim-(vector2f)location )*scalar( speed ), damage );
+	if (modifiers&kDrunkenModifier)
+		b->add_modifier( arena_.create<drunken_modifier>() );
+	if (modifiers&kAcceleratingModifier)
+		b->add_modifier( arena_.create<accelerating_modifier>() );
+	if (modifiers&kSplittingModifier)
+		b->add_modifier( arena_.create<splitting_modifier>() );
+	b->set_effects( modifiers&kEffectModifiers );
 	register_bullet( b );
 }
 
 void simulation::create_bi_bullet( const point &location, double speed, size_t spread )
 {
-	auto dir = normalize( (vector2f)target_-(vector2f)location )*speed;
+	if (target_.x==location.x && target_.y==location.y)
+		return;
+	auto dir = normalize( (vector2f)target_-(vector2f)location )*scalar( speed );
 	vector2f dir1{ dir.x-dir.y/spread, dir.y+dir.x/spread };
 	vector2f dir2{ dir.x+dir.y/spread, dir.y-dir.x/spread };
 
 	// dir1 = dir1 * 0.992;
 	// dir2 = dir2 * 0.992;
 
-	bullets_.add( new bullet( *this, location, dir1 ) );
-	bullets_.add( new bullet( *this, location, dir2 ) );
+	register_bullet( arena_.create<bullet>( *this, location, dir1 ) );
+	register_bullet( arena_.create<bullet>( *this, location, dir2 ) );
 }
 
 void simulation::create_tri_bullet( const point &location, double speed, size_t spread )
 {
-	auto dir = normalize( (vector2f)target_-(vector2f)location )*speed;
+	if (target_.x==location.x && target_.y==location.y)
+		return;
+	auto dir = normalize( (vector2f)target_-(vector2f)location )*scalar( speed );
 	vector2f dir1{ dir.x-dir.y/spread, dir.y+dir.x/spread };
 	vector2f dir2{ dir.x+dir.y/spread, dir.y-dir.x/spread };
 
 	// dir1 = dir1 * 0.992;
 	// dir2 = dir2 * 0.992;
 
-	bullets_.add( new bullet( *this, location, dir ) );
-	bullets_.add( new bullet( *this, location, dir1 ) );
-	bullets_.add( new bullet( *this, location, dir2 ) );
+	register_bullet( arena_.create<bullet>( *this, location, dir ) );
+	register_bullet( arena_.create<bullet>( *this, location, dir1 ) );
+	register_bullet( arena_.create<bullet>( *this, location, dir2 ) );
+}
+
+void simulation::apply_effects( mob *m, uint32_t modifiers )
+{
+	if (modifiers&kSlowingModifier)
+		effects_.add( m, kSlowEffect );
+	if (modifiers&kPoisonModifier)
+		effects_.add( m, kPoisonEffect );
+	if (modifiers&kStunningModifier)
+		effects_.add( m, kStunEffect );
 }
 
 void simulation::damage_base( size_t damage )
 {
 	if (base_.damage( damage ))
 	{
-		std::clog << "GAME OVER\n";
+		logger::info( logger::kSimulation, "game over" );
 		sound_manager::sm.play_foreground( snd_game_over_, 999 );
 	}
-	std::clog << "Remaining health :" << base_.get_hp() << " (-" << damage << ")\n";
+	logger::info( logger::kSimulation, "base hit", "hp", base_.get_hp(), "damage", damage );
 }
 
+	//	The stale handle also takes the mob out of the targets of this tick
 void simulation::destroy_mob( mob *m )
 {
-	std::clog << "destroy mob " << m << std::endl;
+	if (!mob_handles_.erase( m->get_handle() ))
+		return;
+	live_mobs_--;
+	logger::debug( logger::kSimulation, "mob destroyed", "mob", m );
 	m->remove();
 	dead_mobs_.push_back(m);
+	effects_.remove( m );
 }
 
 void simulation::destroy_bullet( bullet *b )
 {
+	if (!bullet_handles_.erase( b->get_handle() ))
+		return;
 	b->remove();
 	dead_bullets_.push_back(b);
 }
 
 mob *simulation::find_mob( const point &location, size_t radius )
 {
-	for (auto m=mobs_.begin();m!=mobs_.end();m=m->next_)
+	for (auto m=mobs_.begin();m!=mobs_.end();m=m->next())
 		if (distance(m->location(),location)<=radius)
 			return m;
 	return nullptr;
 }
 
+void simulation::index_mobs()
+{
+	lane_mobs_.clear();
+	size_t order = 0;
+	for (auto m=mobs_.begin();m!=mobs_.end();m=m->next())
+		lane_mobs_.push_back( { m->lane(), m->position(), order++, m } );
+	std::sort( lane_mobs_.begin(), lane_mobs_.end() );
+}
+
+	//	In each covered interval, the leading mob is the last one before its end: a binary search per interval
+	//	Mobs without a lane are checked by distance
+mob *simulation::find_mob( const coverage &coverage, const point &location, size_t radius ) const
+{
+	const lane_mob *res = nullptr;
+	auto better = [&]( const lane_mob &c ) { return !res || res->position<c.position || (res->position==c.position && c.order<res->order); };
+
+	for (auto &c:lane_mobs_)
+	{
+		if (c.lane)
+			break;
+		if (distance( c.m->location(), location )<=radius && better( c ))
+			res = &c;
+	}
+
+	for (auto &i:coverage.intervals())
+	{
+		auto end = scalar( (double)(i.end+1) );
+		auto c = std::lower_bound( lane_mobs_.begin(), lane_mobs_.end(), i, [&]( const lane_mob &m, const coverage_interval &k ) { return m.lane<k.lane || (m.lane==k.lane && m.position<end); } );
+		if (c==lane_mobs_.begin())
+			continue;
+		--c;
+		if (c->lane==i.lane && !(c->position<scalar( (double)i.begin )) && better( *c ))
+			res = &*c;
+	}
+
+	return res?res->m:nullptr;
+}
+
+point simulation::find_aim( const coverage *coverage, const point &location, size_t radius ) const
+{
+	if (coverage)
+		if (auto m = find_mob( *coverage, location, radius ))
+			return m->location();
+	return target_;
+}
+
+void simulation::find_hits( size_t bullet, const vector2f &from, const vector2f &delta, double radius, std::vector<bullet_commands::hit> &hits ) const
+{
+	auto first = hits.size();
+	for (size_t i=0;i!=targets_.size();i++)
+	{
+		double t;
+		if (mob_handles_.contains( targets_[i].m ) && segment_hits_circle( from, delta, targets_[i].location, scalar( radius ), t ))
+			hits.push_back( { bullet, i, t } );
+	}
+		//	Ties keep the targets order
+	std::stable_sort( hits.begin()+first, hits.end(), []( const bullet_commands::hit &a, const bullet_commands::hit &b ) { return a.t<b.t; } );
+}
@@ -2,41 +2,162 @@
 #define SIMULATION_INCLUDED__
 
 #include <vector>
+#include <queue>
+#include <functional>
 
 #include "core.hpp"
+#include "arena.hpp"
+#include "slot_map.hpp"
+#include "sim_event.hpp"
 #include "path.hpp"
+#include "coverage.hpp"
+#include "status_effects.hpp"
+#include "flow_field.hpp"
 #include "base.hpp"
 #include "sound_manager.hpp"
 
 class mob;
 class bullet;
 class tower;
+class thread_pool;
+
+///	Bullet step modifiers, as a bit set
+enum eModifier : uint32_t
+{
+	kDrunkenModifier = 1,
+	kAcceleratingModifier = 2,
+	kSplittingModifier = 4,
+		//	Effects left on the mob hit
+	kSlowingModifier = 8,
+	kPoisonModifier = 16,
+	kStunningModifier = 32,
+	kEffectModifiers = kSlowingModifier|kPoisonModifier|kStunningModifier
+};
+
+///	The characteristics of a tower, as set up by the items of the game
+struct tower_stats
+{
+	size_t cooldown = 30;		///	Number of ticks between shots
+	size_t damage = 50;			///	Damage of each bullet
+	uint32_t modifiers = kSplittingModifier;	///	eModifier bits added to each bullet
+	eRange range = kMediumRange;				///	Where the tower looks for mobs to aim at
+};
+
+///	What updating a range of bullets produces, merged in bullet order at the end of the step
+struct bullet_commands
+{
+	struct hit
+	{
+		size_t bullet;		///	Index of the bullet in the step
+		size_t target;		///	Index in the targets
+		double t;			///	Where on the bullet move
+	};
+	std::vector<hit> hits;			///	For each bullet, every mob on its way, nearest first
+	std::vector<bullet *> spawned;	///	New bullets, registered after the merge
+
+	void clear() { hits.clear(); spawned.clear(); }
+};
 
 ///	A simulation manages the game during a single wave
 class simulation
 {
 	size_t timestamp_=0;
 
+	///	Mobs, bullets and their modifiers live here, and are all released with the simulation
+	///	Declared first, so it is destroyed last
+	arena arena_;
+
 	base base_;
 
 	dlist<mob> mobs_;
 	dlist<bullet> bullets_;
+
+	///	Mobs and bullets are referred to by handle by anything that may outlive them
+	slot_map<mob> mob_handles_{ 1024 };
+	slot_map<bullet> bullet_handles_{ 1024 };
 	std::vector<tower *> towers_; //{ 192, 160 }
 
+	///	Towers waiting for their next effect, soonest first
+	///	Stale entries (tower rescheduled since) are skipped when they come up
+	struct tower_event
+	{
+		size_t timestamp;
+		size_t order;
+		size_t generation;	///	Matches the tower generation if this is its current event
+		tower *t;
+
+		bool operator>( const tower_event &o ) const { return timestamp>o.timestamp || (timestamp==o.timestamp && order>o.order); }
+	};
+	std::priority_queue<tower_event,std::vector<tower_event>,std::greater<tower_event>> tower_events_;
+	std::vector<tower *> firing_towers_;	///	Towers due this tick, grouped by kind
+
 	point target_{ 0,0 };
 
+	///	Mob locations, gathered once per tick before the bullets move
+	struct target
+	{
+		vector2f location;
+		handle m;		///	Stale once the mob is destroyed
+	};
+	std::vector<target> targets_;
+
+	///	Mobs sorted by lane then position, rebuilt when towers fire, so a tower only looks at
+	///	the parts of the lanes it covers. Mobs following the flow field have no lane, and come first
+	struct lane_mob
+	{
+		const path *lane;
+		scalar position;
+		size_t order;		///	In the mob list: of the mobs at the same place, the first one in the list leads
+		mob *m;
+
+		///	Last of equal positions is the first in the list
+		bool operator<( const lane_mob &o ) const
+		{
+			if (lane!=o.lane)
+				return lane<o.lane;
+			if (!(position==o.position))
+				return position<o.position;
+			return order>o.order;
+		}
+	};
+	std::vector<lane_mob> lane_mobs_;
+
+	void index_mobs();
+
+	status_effects effects_;
+
+	///	Bullets are updated in chunks, possibly in parallel, then merged in order
+	///	The result does not depend on the number of threads, nor on the size of the chunks
+	size_t bullet_chunk_ = 256;
+	thread_pool *pool_ = nullptr;
+
+	const flow_field *flow_field_ = nullptr;	///	If set, mobs follow it to the base instead of their lane
+	sim_event_queue *events_ = nullptr;		///	If set, receives the sim_event of each tick
+	std::vector<bullet *> stepping_;			///	Bullets of this step, in list order
+	std::vector<bullet_commands> commands_;	///	One per chunk
+
+	void step_bullets();
+
+	///	Mobs are destroyed in the mob step, which must not allocate: registering a mob
+	///	makes room for all the live mobs to die in the same tick
 	std::vector<mob*> dead_mobs_;
+	size_t live_mobs_ = 0;
 	std::vector<bullet*> dead_bullets_;
 
 	size_t snd_bullet_;
 	size_t snd_game_over_;
 
+	void fire_towers();
+
 public:
 	simulation() :
 		base_{ point{ kBaseX, kBaseY } },
 	snd_bullet_{ sound_manager::sm.register_sound( "assets/bullets/bullet00.wav" ) },
 	snd_game_over_{ sound_manager::sm.register_sound( "assets/general/game-over.wav" ) }
-	{}
+	{
+		dead_mobs_.reserve( 256 );
+		lane_mobs_.reserve( 256 );
+	}
 	~simulation();
 
 	simulation( const simulation & ) = delete;
@@ -45,24 +166,58 @@ public:
 
 	void set_target( const point &p ) { target_ = p; }
 
+	arena &get_arena() { return arena_; }
+	const arena &get_arena() const { return arena_; }
+
+	///	Bullets are updated on that pool, if any
+	void set_thread_pool( thread_pool *pool ) { pool_ = pool; }
+
+	///	Bullets per chunk of the update. Does not change the result, only how the work is split
+	void set_bullet_chunk( size_t chunk ) { bullet_chunk_ = std::max( chunk, (size_t)1 ); }
+
+	///	Must not change while the simulation runs
+	void set_flow_field( const flow_field *field ) { flow_field_ = field; }
+	const flow_field *get_flow_field() const { return flow_field_; }
+
+	///	Must not change while the simulation runs. Events never change the simulation
+	void set_event_queue( sim_event_queue *events ) { events_ = events; }
+	void emit( sim_event::eKind kind, const point &location )
+	{
+		if (events_)
+			events_->push( { kind, location } );
+	}
+
 	/// Register a new bullet
-	void register_bullet( bullet *bullet ) { bullets_.add(bullet); }
+	void register_bullet( bullet *bullet );
 
 	void step();
 
-	tower *create_tower( const point &location );
+	///	A tower with a coverage aims at the mobs in it, otherwise at the player target
+	tower *create_tower( const point &location, const tower_stats &stats = {}, const coverage *coverage = nullptr );
+	void schedule_tower( tower *t );
 	std::vector<tower *> &all_towers() { return towers_; }
 	
 	void register_mob( mob *mob );
 
-	void create_bullet( const point &location, double speed );
+	void play_fire_sound();
+	void create_bullet( const point &location, const point &aim, double speed, size_t damage, uint32_t modifiers );
 	void create_bi_bullet( const point &location, double speed, size_t spread );
 	void create_tri_bullet( const point &location, double speed, size_t spread );
 
+	///	Starts the effects of the eModifier bits on a mob hit by a bullet
+	void apply_effects( mob *m, uint32_t modifiers );
+	const status_effects &get_effects() const { return effects_; }
+
 	void damage_base( size_t damage );
+
+	///	Destroying twice in a tick does nothing the second time
 	void destroy_mob( mob *m );
 	void destroy_bullet( bullet *b );
 
+	///	nullptr if the mob or bullet is gone
+	mob *get_mob( handle h ) const { return mob_handles_.get( h ); }
+	bullet *get_bullet( handle h ) const { return bullet_handles_.get( h ); }
+
 	bool has_towers();	//	?####
 	bool game_over() const { return base_.get_hp()==0; }
 	bool has_mobs() const { return !mobs_.is_empty(); }
@@ -73,6 +228,18 @@ public:
 	const dlist<bullet> *get_bullets() const { return &bullets_; }
 
 	mob *find_mob( const point &location, size_t radius );
+
+	///	The mob furthest on its way among the ones in the coverage, or nullptr
+	///	Only valid while the towers fire, when the mobs are indexed by lane
+	///	Mobs off the lanes (following a flow field) are in range if they are within radius of location
+	mob *find_mob( const coverage &coverage, const point &location, size_t radius ) const;
+
+	///	Where a tower aims: the leading mob in its coverage, or the player target if there is none
+	point find_aim( const coverage *coverage, const point &location, size_t radius ) const;
+
+	///	Adds to 'hits' every mob hit by something of the given radius moving from 'from' to 'from+delta', nearest first
+	///	Only reads the targets, so it can be called from any thread during the bullet update
+	void find_hits( size_t bullet, const vector2f &from, const vector2f &delta, double radius, std::vector<bullet_commands::hit> &hits ) const;
 };
 
 class simulated
@@ -0,0 +1,109 @@
+//
+//  slot_map.hpp
+//  TowerMac
+//
+
+#ifndef SLOT_MAP_INCLUDED__
+#define SLOT_MAP_INCLUDED__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+///	A reference to an object of a slot_map, which can be kept after the object is gone
+///	The low bits are the index of a slot, the high bits the generation of that slot when the handle was made
+typedef uint32_t handle;
+
+///	Never refers to anything
+const handle kNoHandle = 0;
+
+///	Generational handles to objects that live elsewhere (like in the arena)
+///	Each slot keeps the handle of its current object: a lookup is a single compare,
+///	and a handle goes stale as soon as its object is erased, even if the slot is reused
+///	Free slots are reused oldest first, so a generation only comes back after many erasures of all of them,
+///	and a slot whose generations are used up is retired rather than reused
+template <typename T> class slot_map
+{
+	static const uint32_t kIndexBits = 20;
+	static const uint32_t kIndexMask = (1u<<kIndexBits)-1;
+	static const uint32_t kGeneration = 1u<<kIndexBits;	///	Added to a handle to make the next one of its slot
+
+	struct slot
+	{
+		handle h;		///	Of the current object, or of the last one if free
+		T *object;		///	nullptr if free
+		uint32_t next_free;	///	If free, the next one to reuse, 0 for none
+	};
+	std::vector<slot> slots_;
+
+		//	Queue of the free slots, linked through the slots. Slot 0 is never free, so 0 means none
+	uint32_t free_head_ = 0;	///	Erased first, reused first
+	uint32_t free_tail_ = 0;
+
+public:
+	///	Slot 0 is never used, so kNoHandle is never valid
+	slot_map( size_t capacity = 0 )
+	{
+		slots_.reserve( capacity+1 );
+		slots_.push_back( { ~kNoHandle, nullptr, 0 } );
+	}
+	slot_map( const slot_map & ) = delete;
+
+	handle insert( T *object )
+	{
+		uint32_t index;
+		if (!free_head_)
+		{
+			index = (uint32_t)slots_.size();
+			if (index>kIndexMask)
+				throw "Too many objects in slot map";
+			slots_.push_back( { index, nullptr, 0 } );
+		}
+		else
+		{
+			index = free_head_;
+			free_head_ = slots_[index].next_free;
+			if (!free_head_)
+				free_tail_ = 0;
+		}
+		auto &s = slots_[index];
+		s.h = (s.h&~kIndexMask)|index;
+		s.object = object;
+		return s.h;
+	}
+
+	///	Returns false if the handle was already stale, so erasing twice is harmless
+	bool erase( handle h )
+	{
+		auto index = h&kIndexMask;
+		auto &s = slots_[index];
+		if (s.h!=h)
+			return false;
+		s.object = nullptr;
+		s.h += kGeneration;
+		if (!(s.h&~kIndexMask))
+		{
+				//	Back to the first generation: retired, with a handle of another index, that nothing matches
+			s.h = ~index;
+			return true;
+		}
+		s.next_free = 0;
+		if (free_tail_)
+			slots_[free_tail_].next_free = index;
+		else
+			free_head_ = index;
+		free_tail_ = index;
+		return true;
+	}
+
+	///	nullptr if the object was erased
+	T *get( handle h ) const
+	{
+		auto &s = slots_[h&kIndexMask];
+		return s.h==h?s.object:nullptr;
+	}
+
+	bool contains( handle h ) const { return slots_[h&kIndexMask].h==h; }
+};
+
+#endif
@@ -6,7 +6,8 @@
 //
 
 #include "sound_manager.hpp"
-#include <iostream>
+#include "music_stream.hpp"
+#include "logger.hpp"
 #include <algorithm>
 
 #define MIX_AUDIO
@@ -19,12 +20,26 @@ void sound_manager::sdl_callback( void *, Uint8 *stream, int len )
 {
 	assert( len==FRAME );
 
+	auto start = SDL_GetPerformanceCounter();
 	sm.next_frame( stream );
+	sm.callback_time_.store( SDL_GetPerformanceCounter()-start, std::memory_order_relaxed );
 }
 
 void sound_manager::next_frame( uint8_t *data )
 {
-	if (background_==nullptr)
+	auto background = background_;
+	music_stream::frame streamed;
+	if (music_)
+	{
+		if (!music_->read( streamed ))
+		{
+			music_->count_underrun();
+			std::fill( streamed.begin(), streamed.end(), 128 );
+		}
+		background = streamed.data();
+	}
+
+	if (background==nullptr)
 	{
 		for (auto i=0;i!=FRAME;i++)
 			data[i] = 128;
@@ -32,13 +47,13 @@ void sound_manager::next_frame( uint8_t *data )
 	}
 
 #ifdef MIX_AUDIO
-	if (foreground_ && background_)
+	if (foreground_ && background)
 	{
 		//  mix
 		for (int i=0;i!=FRAME;i++)
 //            data[i] = ((int)foreground_[i]*1+(int)background_[i]*1)/2;
 		{
-			int s = (int)foreground_[i]+(int)background_[i]-128;
+			int s = (int)foreground_[i]+(int)background[i]-128;
 			if (s<0) s = 0;
 			if (s>255) s = 255;
 			data[i] = s;
@@ -50,7 +65,7 @@ void sound_manager::next_frame( uint8_t *data )
 			std::copy( foreground_, foreground_+FRAME, data );
 		else
 		{
-			std::copy( background_, background_+FRAME, data );
+			std::copy( background, background+FRAME, data );
 //			std::clog << "B" << std::flush;
 		}
 			
@@ -64,10 +79,13 @@ void sound_manager::next_frame( uint8_t *data )
 		}
 	}
 
-	//  Always advance background
-	background_ += FRAME;
-	if (background_==background_end_)
-		background_ = background_begin_;
+	//  Always advance a resident background (streamed ones advance by themselves)
+	if (background_)
+	{
+		background_ += FRAME;
+		if (background_==background_end_)
+			background_ = background_begin_;
+	}
 }
 
 sound_manager::sound_manager()
@@ -88,6 +106,11 @@ sound_manager::sound_manager()
 	SDL_PauseAudio(0);
 }
 
+	//	Here, where music_stream is complete
+sound_manager::~sound_manager()
+{
+}
+
 
 std::unique_ptr<class sound> sound_manager::load_sound( const std::string &name ) const
 {
@@ -100,22 +123,19 @@ std::unique_ptr<class sound> sound_manager::load_sound( const std::string &name
 	
 	if (SDL_LoadWAV( cname, &wave, &data, &dlen ) == NULL)
 	{
-		std::cerr << "Cannot load " << name << " : " << SDL_GetError() << "\n";
+		logger::error( logger::kSound, "cannot load sound", "file", name, "reason", SDL_GetError() );
 		return nullptr;
 	}
 	auto err = SDL_BuildAudioCVT(&cvt, wave.format, wave.channels, wave.freq, spec_.format, spec_.channels, spec_.freq);
 	if (err==-1)
 	{
-		std::cerr << "Cannot comvert " << name << " : " << SDL_GetError() << "\n";
+		logger::error( logger::kSound, "cannot convert sound", "file", name, "reason", SDL_GetError() );
 		return nullptr;
 	}
 	if (err==1)
 	{
-		std::clog << "#### Will convert sound to 8 bits PCM\n";
-		std::clog << "  freq from " << wave.freq << " to " << spec_.freq << "\n";
-		std::clog << "  format from " << wave.format << " to " << spec_.format << "\n";
-		std::clog << "  channels from " << (int)wave.channels << " to " << (int)spec_.channels << "\n";
-		std::clog << "  on " << wave.samples << " samples\n";
+		logger::debug( logger::kSound, "converting sound", "file", name, "freq", wave.freq, "format", wave.format, "channels", wave.channels, "samples", wave.samples );
+		logger::debug( logger::kSound, "converted to", "freq", spec_.freq, "format", spec_.format, "channels", spec_.channels );
 	}
 
 	cvt.len = dlen;
@@ -125,9 +145,11 @@ std::unique_ptr<class sound> sound_manager::load_sound( const std::string &name
 	SDL_FreeWAV(data);
 	
 	auto sound_len = cvt.len_cvt/FRAME;
-	std::clog << "Truncating to " << sound_len  << " frames (" << sound_len*FRAME << " bytes)\n";
+	logger::debug( logger::kSound, "sound loaded", "file", name, "frames", sound_len, "bytes", sound_len*FRAME );
 
-	return std::make_unique<class sound>( cvt.buf, sound_len );
+	auto res = std::make_unique<class sound>( cvt.buf, sound_len );
+	free( cvt.buf );
+	return res;
 }
 
 size_t sound_manager::register_sound( const std::string &name )
@@ -141,17 +163,43 @@ size_t sound_manager::register_sound( const std::string &name )
 
 void sound_manager::play_background( size_t snd )
 {
+	std::unique_ptr<music_stream> music;
+	SDL_LockAudio();
+	std::swap( music_, music );
 	background_ = background_begin_ = sounds_[snd]->begin();
 	background_end_ = sounds_[snd]->end();
+	SDL_UnlockAudio();
+}
+
+	//	The previous music, if any, is stopped once the audio is unlocked, as its reader thread may take a while
+bool sound_manager::play_music( const std::string &filename )
+{
+	auto music = music_stream::open( filename, spec_ );
+	if (!music)
+		return false;
+
+	SDL_LockAudio();
+	std::swap( music_, music );
+	background_ = background_begin_ = background_end_ = nullptr;
+	SDL_UnlockAudio();
+	return true;
+}
+
+size_t sound_manager::music_underruns() const
+{
+	return music_?music_->underruns():0;
 }
 
 	/// Plays forground sound (if priority is right)
+	/// Called from the simulation thread too: the audio callback moves foreground_, so this holds the audio lock
 void sound_manager::play_foreground( size_t snd, int priority )
 {
-	if (foreground_ && foreground_priority_>=priority)
-		return;     //  Skip if already playing an important sound
-
-	foreground_ = sounds_[snd]->begin();
-	foreground_end_ = sounds_[snd]->end();
-	foreground_priority_ = priority;
+	SDL_LockAudio();
+	if (!foreground_ || foreground_priority_<priority)     //  Skip if already playing an important sound
+	{
+		foreground_ = sounds_[snd]->begin();
+		foreground_end_ = sounds_[snd]->end();
+		foreground_priority_ = priority;
+	}
+	SDL_UnlockAudio();
 }
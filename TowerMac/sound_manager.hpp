@@ -12,6 +12,7 @@
 #define SOUND_MANAGER_INCLUDED__
 
 #include <stdio.h>
+#include <atomic>
 #include <array>
 #include <vector>
 #include <cstdint>
@@ -19,6 +20,8 @@
 
 const int FRAME = 370;  /// How many samples per ticks
 
+class music_stream;
+
 /// This is a sound that can be played by the manager
 class sound
 {
@@ -37,7 +40,7 @@ public:
 
 	~sound()
 	{
-		delete data_;
+		free( data_ );
 		data_ = nullptr;
 		frames_ = 0;
 	}
@@ -57,17 +60,23 @@ class sound_manager
 {
 	SDL_AudioSpec spec_;
 	sound_manager();
+	~sound_manager();
 
 	std::vector<std::unique_ptr<sound>> sounds_;
 	
 	std::unique_ptr<sound> load_sound( const std::string &name ) const;
 
+	///	Streamed background, played instead of a resident one. Only changed with the audio locked
+	std::unique_ptr<music_stream> music_;
+
 	const uint8_t *background_begin_ = nullptr;
 	const uint8_t *background_end_ = nullptr;
 	const uint8_t *background_ = nullptr;
 	const uint8_t *foreground_ = nullptr;
 	const uint8_t *foreground_end_ = nullptr;
 	size_t foreground_priority_ = 0;
+
+	std::atomic<uint64_t> callback_time_{ 0 };	///	Of the last callback, in performance counter units
 	
 	static void sdl_callback( void *, Uint8 *stream, int len );
 	void next_frame( uint8_t *data );
@@ -84,8 +93,18 @@ public:
 		/// Plays background sound (in loop)
 	void play_background( size_t snd );
 
+		/// Plays a WAV file as the background loop, read from the disk as it plays
+		/// For long music, which would take megabytes as a registered sound. Returns false if it cannot be played
+	bool play_music( const std::string &filename );
+
+		/// Background frames that were not read from the disk in time, and were played as silence
+	size_t music_underruns() const;
+
 		/// Plays forground sound (if priority is right)
 	void play_foreground( size_t snd, int priority );
+
+		/// Time spent in the last audio callback, in ms
+	double callback_time() const { return callback_time_.load( std::memory_order_relaxed )*1000.0/SDL_GetPerformanceFrequency(); }
 };
 
 #endif
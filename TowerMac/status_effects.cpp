@@ -0,0 +1,125 @@
+//
+//  status_effects.cpp
+//  TowerMac
+//
+
+#include "status_effects.hpp"
+
+#include "simulation.hpp"
+#include "mob.hpp"
+#include "bullet.hpp"
+
+namespace
+{
+	///	Standard duration and magnitude of each effect
+	struct effect_def
+	{
+		uint32_t ticks;
+		uint32_t magnitude;
+	};
+
+	const effect_def kEffectDefs[kEffectCount] =
+	{
+		{ 60, 50 },		//	kSlowEffect: half speed for a second
+		{ 90, 2 },		//	kPoisonEffect
+		{ 20, 0 },		//	kStunEffect
+	};
+}
+
+status_effects::status_effects()
+{
+		//	Adding effects happens when bullets hit, which should not allocate in the usual waves
+	for (auto &e:entries_)
+		e.reserve( 256 );
+}
+
+void status_effects::remove_at( eEffect kind, size_t index )
+{
+	auto &entries = entries_[kind];
+	entries[index].m->effect_slots_[kind] = -1;
+	if (index!=entries.size()-1)
+	{
+		entries[index] = entries.back();
+		entries[index].m->effect_slots_[kind] = (int32_t)index;
+	}
+	entries.pop_back();
+}
+
+void status_effects::update_speed( mob *m ) const
+{
+	if (m->effect_slots_[kStunEffect]>=0)
+		m->speed_ = 0;
+	else if (m->effect_slots_[kSlowEffect]>=0)
+		m->speed_ = m->base_speed_*scalar( entries_[kSlowEffect][m->effect_slots_[kSlowEffect]].magnitude/100.0 );
+	else
+		m->speed_ = m->base_speed_;
+}
+
+void status_effects::add( mob *m, eEffect kind, uint32_t ticks, uint32_t magnitude )
+{
+	auto &entries = entries_[kind];
+	auto slot = m->effect_slots_[kind];
+	if (slot>=0)
+	{
+		auto &e = entries[slot];
+		e.ticks = ticks;
+			//	The strongest slow keeps the least speed
+		if (kind==kSlowEffect?magnitude<e.magnitude:magnitude>e.magnitude)
+			e.magnitude = magnitude;
+	}
+	else
+	{
+		m->effect_slots_[kind] = (int32_t)entries.size();
+		entries.push_back( { m, ticks, magnitude } );
+	}
+
+	if (kind!=kPoisonEffect)
+		update_speed( m );
+}
+
+void status_effects::add( mob *m, eEffect kind )
+{
+	add( m, kind, kEffectDefs[kind].ticks, kEffectDefs[kind].magnitude );
+}
+
+	//	The mob is going away: no need to restore its speed
+void status_effects::remove( mob *m )
+{
+	for (int k=0;k!=kEffectCount;k++)
+		if (m->effect_slots_[k]>=0)
+			remove_at( (eEffect)k, m->effect_slots_[k] );
+}
+
+void status_effects::step_slow_or_stun( eEffect kind )
+{
+	auto &entries = entries_[kind];
+	for (auto i=entries.size();i--;)
+		if (--entries[i].ticks==0)
+		{
+			auto m = entries[i].m;
+			remove_at( kind, i );
+			update_speed( m );
+		}
+}
+
+	//	Backwards, so the entries swapped into a hole are the ones already done,
+	//	whether the hole comes from an expired poison or from a mob killed by it
+void status_effects::step_poison()
+{
+	auto &entries = entries_[kPoisonEffect];
+	for (auto i=entries.size();i--;)
+	{
+		auto m = entries[i].m;
+		auto damage = entries[i].magnitude;
+		if (--entries[i].ticks==0)
+			remove_at( kPoisonEffect, i );
+		m->damage( damage );
+	}
+}
+
+void status_effects::step()
+{
+	step_poison();
+	step_slow_or_stun( kSlowEffect );
+	step_slow_or_stun( kStunEffect );
+}
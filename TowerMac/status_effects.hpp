@@ -0,0 +1,68 @@
+//
+//  status_effects.hpp
+//  TowerMac
+//
+
+#ifndef STATUS_EFFECTS_INCLUDED__
+#define STATUS_EFFECTS_INCLUDED__
+
+#include <cstdint>
+#include <vector>
+
+#include "core.hpp"
+
+class mob;
+class simulation;
+
+///	What a bullet can leave on the mob it hits
+enum eEffect : uint8_t
+{
+	kSlowEffect,		///	Magnitude: percentage of the speed kept
+	kPoisonEffect,		///	Magnitude: damage per tick
+	kStunEffect,		///	No magnitude: the mob does not move
+	kEffectCount
+};
+
+///	The status effects of all the mobs of a simulation
+///	Each kind of effect is a dense array of the mobs under it, updated in one pass per kind,
+///	so a tick costs one entry per active effect, whatever the number of mobs
+///	A mob has at most one entry per kind, and knows where it is, so it can be found and removed at once
+class status_effects
+{
+	struct entry
+	{
+		mob *m;
+		uint32_t ticks;			///	Left, including the current one
+		uint32_t magnitude;
+	};
+	std::vector<entry> entries_[kEffectCount];
+
+	///	Swaps the last entry into the hole
+	void remove_at( eEffect kind, size_t index );
+
+	///	Recomputes the speed of the mob from its slow and stun entries
+	void update_speed( mob *m ) const;
+
+	void step_slow_or_stun( eEffect kind );
+	void step_poison();
+
+public:
+	status_effects();
+	status_effects( const status_effects & ) = delete;
+
+	///	Starts an effect on a mob. If it is already under it, the duration restarts and the strongest magnitude is kept
+	void add( mob *m, eEffect kind, uint32_t ticks, uint32_t magnitude );
+
+	///	Starts an effect with its standard duration and magnitude
+	void add( mob *m, eEffect kind );
+
+	///	Called when a mob is destroyed
+	void remove( mob *m );
+
+	///	Slows, stuns and poisons for one tick. Poison may destroy mobs
+	void step();
+
+	size_t count( eEffect kind ) const { return entries_[kind].size(); }
+};
+
+#endif
@@ -0,0 +1,177 @@
+//
+//  stress.cpp
+//  TowerMac
+//
+//  Headless run of a stress scenario, for end-to-end numbers release over release (see 'make stress')
+//  A scenario is a directory with its own mobs.def, waves.def and lanes.def (each optional, the ones
+//  of the game are used otherwise) and a loadout.tm save with the towers
+//  All the waves of the scenario are played in order, to the end, even after the base is destroyed
+//  Built with -DTM_ALLOC_PROFILE, only reports the allocations in the ticks, as counting them skews the times
+//  Arguments: scenario directory, threads
+//
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <SDL2/SDL.h>
+
+SDL_Renderer *gRenderer = nullptr;
+
+#include "simulation.hpp"
+#include "tower.hpp"
+#include "mob.hpp"
+#include "bullet.hpp"
+#include "game.hpp"
+#include "game_def.hpp"
+#include "scheduler.hpp"
+#include "thread_pool.hpp"
+#include "alloc_profiler.hpp"
+#include "logger.hpp"
+
+static const size_t kMaxTicks = 100000;		///	Per wave, in case a scenario never ends
+
+///	Peak resident memory of the process, in MB
+static double peak_rss()
+{
+	rusage usage;
+	getrusage( RUSAGE_SELF, &usage );
+#ifdef __APPLE__
+	return usage.ru_maxrss/(1024.0*1024);		//	Bytes
+#else
+	return usage.ru_maxrss/1024.0;				//	KB
+#endif
+}
+
+///	Replaces the definitions of the game with the ones of the scenario
+static void load_scenario( const std::string &directory )
+{
+	unsigned parts = 0;
+	if (!access( (directory+"/lanes.def").c_str(), R_OK ))
+		parts |= def_update::kLanes;
+	if (!access( (directory+"/mobs.def").c_str(), R_OK ))
+		parts |= def_update::kMobs;
+	if (!access( (directory+"/waves.def").c_str(), R_OK ))
+		parts |= def_update::kWaves;
+	if (parts && !game_def::spec.apply( std::move( *def_update::load( parts, directory ) ) ))
+		throw "Bad scenario definitions";
+}
+
+int main( int argc, char *argv[] )
+{
+	if (argc<2)
+	{
+		std::cerr << "usage: " << argv[0] << " <scenario directory> [threads]\n";
+		return 1;
+	}
+	std::string directory = argv[1];
+	size_t threads = argc>2?atoi( argv[2] ):1;
+
+	auto name = directory;
+	while (!name.empty() && name.back()=='/')
+		name.pop_back();
+	name = name.substr( name.find_last_of( '/' )+1 );
+
+	if (SDL_Init( SDL_INIT_VIDEO )<0)
+	{
+		std::cerr << "could not initialize sdl2: " << SDL_GetError() << "\n";
+		return 1;
+	}
+		//	Images need a renderer, but nothing is ever drawn
+	auto surface = SDL_CreateRGBSurface( 0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, 0, 0, 0, 0 );
+	gRenderer = SDL_CreateSoftwareRenderer( surface );
+
+		//	Keep the per kill records out of the measure
+	logger::set_level( logger::kWarning );
+
+		//	Built with -DTM_ALLOC_PROFILE: TM_ALLOC_STRICT aborts on allocations in allocation free sections
+	alloc_profiler::set_strict( getenv( "TM_ALLOC_STRICT" )!=nullptr );
+
+	try
+	{
+		load_scenario( directory );
+		auto game = game::load( directory+"/loadout.tm" );
+
+		thread_pool pool( threads );
+		std::vector<double> tick_times;		///	In microseconds
+		size_t peak_mobs = 0;
+		size_t peak_bullets = 0;
+		size_t waves = game_def::spec.wave_defs().size();
+		size_t game_overs = 0;
+		size_t allocations = 0;		///	In the ticks, creating the simulations is not counted
+
+		for (size_t w=0;w!=waves;w++)
+		{
+			simulation sim;
+			sim.set_thread_pool( &pool );
+			game->apply( sim );
+			sim.set_target( { 128, 128 } );
+
+			auto scheduler = schedule_wave( game_def::spec.get_wave( (int)w ) );
+			for (size_t ticks=0;ticks!=kMaxTicks && (!scheduler.empty() || sim.has_mobs());ticks++)
+			{
+				auto allocated = alloc_profiler::allocations();
+				auto start = std::chrono::steady_clock::now();
+				scheduler.step( sim );
+				sim.step();
+				auto elapsed = std::chrono::steady_clock::now()-start;
+				allocations += alloc_profiler::allocations()-allocated;
+				tick_times.push_back( std::chrono::duration<double,std::micro>( elapsed ).count() );
+
+					//	Counted outside of the measure
+				size_t mobs = 0;
+				for (auto m=sim.get_mobs()->begin();m!=sim.get_mobs()->end();m=m->next())
+					mobs++;
+				size_t bullets = 0;
+				for (auto b=sim.get_bullets()->begin();b!=sim.get_bullets()->end();b=b->next())
+					bullets++;
+				peak_mobs = std::max( peak_mobs, mobs );
+				peak_bullets = std::max( peak_bullets, bullets );
+			}
+			if (sim.game_over())
+				game_overs++;
+		}
+
+		double total = 0;
+		for (auto t:tick_times)
+			total += t;
+		std::sort( tick_times.begin(), tick_times.end() );
+		auto percentile = [&]( double p ) { return tick_times.empty()?0:tick_times[std::min( (size_t)(p*tick_times.size()), tick_times.size()-1 )]; };
+
+#ifdef TM_ALLOC_PROFILE
+		std::cout << "stress-alloc " << name
+			<< " ticks=" << tick_times.size()
+			<< " allocations=" << allocations
+			<< " per_tick=" << (tick_times.empty()?0:(double)allocations/tick_times.size()) << "\n";
+#else
+		std::cout << "stress " << name
+			<< " waves=" << waves
+			<< " towers=" << game->get_loadout().towers().size()
+			<< " ticks=" << tick_times.size()
+			<< " mean=" << (tick_times.empty()?0:total/tick_times.size()) << "us"
+			<< " p99=" << percentile( 0.99 ) << "us"
+			<< " max=" << (tick_times.empty()?0:tick_times.back()) << "us"
+			<< " peak_mobs=" << peak_mobs
+			<< " peak_bullets=" << peak_bullets
+			<< " rss=" << peak_rss() << "MB"
+			<< " game_overs=" << game_overs << "\n";
+#endif
+	}
+	catch (const char *e)
+	{
+		std::cerr << name << ": " << e << "\n";
+		return 1;
+	}
+
+	SDL_DestroyRenderer( gRenderer );
+	SDL_FreeSurface( surface );
+	SDL_Quit();
+
+	return 0;
+}
@@ -0,0 +1,120 @@
+//
+//  thread_pool.hpp
+//  TowerMac
+//
+
+#ifndef THREAD_POOL_INCLUDED__
+#define THREAD_POOL_INCLUDED__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+///	A fixed set of threads that run the iterations of a loop together
+///	The calling thread works too, so a pool of size 1 has no thread, and just loops
+class thread_pool
+{
+	std::vector<std::thread> threads_;
+
+	std::mutex mutex_;
+	std::condition_variable start_;
+	std::condition_variable done_;
+
+		//	The loop being run, guarded by mutex_
+	const std::function<void( size_t )> *job_ = nullptr;
+	size_t count_ = 0;
+	size_t generation_ = 0;		///	Incremented for each loop, so the threads know there is work
+	size_t active_ = 0;			///	Threads still working on the current loop
+	bool quit_ = false;
+
+	std::atomic<size_t> next_{ 0 };		///	Next iteration to run
+
+	void drain( const std::function<void( size_t )> &job, size_t count )
+	{
+		size_t i;
+		while ((i=next_.fetch_add( 1, std::memory_order_relaxed ))<count)
+			job( i );
+	}
+
+	void work()
+	{
+		size_t seen = 0;
+		for (;;)
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			start_.wait( lock, [&]{ return quit_ || generation_!=seen; } );
+			if (quit_)
+				return;
+			seen = generation_;
+			if (!job_)
+				continue;		//	Woke up too late, that loop is already over
+			auto job = job_;
+			auto count = count_;
+			active_++;
+			lock.unlock();
+
+			drain( *job, count );
+
+			lock.lock();
+			if (--active_==0)
+				done_.notify_one();
+		}
+	}
+
+public:
+	///	'size' is the number of threads working on each loop, including the caller
+	explicit thread_pool( size_t size )
+	{
+		for (size_t i=1;i<size;i++)
+			threads_.emplace_back( [this]{ work(); } );
+	}
+
+	~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> guard( mutex_ );
+			quit_ = true;
+		}
+		start_.notify_all();
+		for (auto &t:threads_)
+			t.join();
+	}
+
+	thread_pool( const thread_pool & ) = delete;
+
+	size_t size() const { return threads_.size()+1; }
+
+	///	Calls job(i) for each i in [0,count), in any order and on any thread, and returns when all are done
+	void run( size_t count, const std::function<void( size_t )> &job )
+	{
+		if (threads_.empty() || count<=1)
+		{
+			for (size_t i=0;i!=count;i++)
+				job( i );
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> guard( mutex_ );
+			job_ = &job;
+			count_ = count;
+			next_.store( 0, std::memory_order_relaxed );
+			generation_++;
+			active_++;		//	The caller
+		}
+		start_.notify_all();
+
+		drain( job, count );
+
+			//	All iterations are taken, wait for the threads still running theirs
+		std::unique_lock<std::mutex> lock( mutex_ );
+		active_--;
+		done_.wait( lock, [&]{ return active_==0; } );
+		job_ = nullptr;
+	}
+};
+
+#endif
@@ -5,28 +5,76 @@
 #include "image.hpp"
 #include "sound_manager.hpp"
 
+#include <algorithm>
+
 class tower : public simulated
 {
+public:
+	///	Towers of the same kind that fire on the same tick are dispatched together
+	enum class eTowerKind
+	{
+		kBasic,
+		kBi,
+		kTri
+	};
+
+private:
 	image image_{ "assets/towers/tower01.bmp" };
-	size_t charge_;        //  When 0, tower is charged
 
 	point location_;
 	size_t cooldown_;      //  Number of ticks between ready to fire
+	eTowerKind kind_;
+
+		//	Scheduling, managed by the simulation
+	size_t start_;			//	Timestamp when the tower started charging
+	size_t next_fire_;		//	Timestamp of the next effect
+	size_t order_ = 0;		//	Creation order, to break ties deterministically
+	size_t generation_ = 0;	//	Incremented each time the tower is rescheduled
+
+	friend class simulation;
+
+	void charge_from( size_t timestamp )
+	{
+		start_ = timestamp;
+		next_fire_ = start_+std::max( cooldown_, (size_t)1 )-1;
+	}
 
 protected:
 	void virtual do_effect() = 0;
 
+	///	Applies the effect of all the towers in [begin,end), all of the same kind as this one
+	virtual void do_effects( tower *const *begin, tower *const *end )
+	{
+		for (auto t=begin;t!=end;t++)
+			(*t)->do_effect();
+	}
+
 public:
-	tower( simulation &simulation, point location, size_t cooldown ) :
+	tower( simulation &simulation, point location, size_t cooldown, eTowerKind kind ) :
 		simulated{ simulation },
 		location_{location},
-		charge_{ cooldown },
-		cooldown_{ cooldown }
-		{}
+		cooldown_{ cooldown },
+		kind_{ kind }
+	{
+		charge_from( simulation.timestamp() );
+	}
 	virtual ~tower(){}
 
 	size_t cooldown() const { return cooldown_; }
-	void set_cooldown( size_t cooldown ) { cooldown_ = cooldown; }
+
+	///	Changes the cooldown of the current charge too, so the next effect is rescheduled
+	void set_cooldown( size_t cooldown )
+	{
+		cooldown_ = cooldown;
+		auto now = simulation_.timestamp();
+		charge_from( start_ );
+		if (next_fire_<now)
+			next_fire_ = now;
+		simulation_.schedule_tower( this );
+	}
+
+	eTowerKind kind() const { return kind_; }
+	size_t next_fire() const { return next_fire_; }
 
 	point location() const { return location_; }
 
@@ -35,32 +83,37 @@ public:
 		image_.render( location_ );
 	}
 
-	void step()
-	{
-		if (charge_)
-		{
-			charge_--;
-		}
-
-		if (charge_==0)
-		{
-			charge_ = cooldown_;
-			do_effect();
-		}
-	}
+	sprite get_sprite() const { return { &image_, location_, location_ }; }
 };
 
 class basic_tower : public tower
 {
 	size_t bullet_speed_ = 5;   //  Speed of the buller
+	size_t damage_;
+	uint32_t modifiers_;
+	const coverage *coverage_;		///	nullptr if the tower always fires at the player target
+	size_t radius_;
 
 	virtual void do_effect()
 	{
-		simulation_.create_bullet( location(), bullet_speed_ );
+		simulation_.create_bullet( location(), simulation_.find_aim( coverage_, location(), radius_ ), bullet_speed_, damage_, modifiers_ );
+	}
+
+	///	One sound for the whole volley
+	virtual void do_effects( tower *const *begin, tower *const *end )
+	{
+		simulation_.play_fire_sound();
+		tower::do_effects( begin, end );
 	}
 
 public:
-	basic_tower( simulation &simulation, point location ) : tower( simulation, location, 30 ) {}
+	basic_tower( simulation &simulation, point location, const tower_stats &stats = {}, const coverage *coverage = nullptr ) :
+		tower( simulation, location, stats.cooldown, eTowerKind::kBasic ),
+		damage_{ stats.damage },
+		modifiers_{ stats.modifiers },
+		coverage_{ coverage },
+		radius_{ kRangeRadius[stats.range] }
+		{}
 };
 
 class bi_tower : public tower
@@ -73,7 +126,7 @@ class bi_tower : public tower
 	}
 
 public:
-	bi_tower( simulation &simulation, point location ) : tower( simulation, location, 15 ) {}
+	bi_tower( simulation &simulation, point location ) : tower( simulation, location, 15, eTowerKind::kBi ) {}
 };
 
 class tri_tower : public tower
@@ -86,7 +139,7 @@ class tri_tower : public tower
 	}
 
 public:
-	tri_tower( simulation &simulation, point location ) : tower( simulation, location, 15 ) {}
+	tri_tower( simulation &simulation, point location ) : tower( simulation, location, 15, eTowerKind::kTri ) {}
 };
 
 #endif
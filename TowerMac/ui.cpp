@@ -17,25 +17,35 @@ static void set_color( graphics::color c )
 
 void graphics::frame_rect( const rect & r )
 {
-	set_color( state_.stroke );
-
 	SDL_Rect rect;
 	rect.x = (int)r.o.x+state_.origin.x;
 	rect.y = (int)r.o.y+state_.origin.y;
 	rect.w = (int)r.s.w+1;
 	rect.h = (int)r.s.h+1;
+	if (framebuffer::screen)
+	{
+		framebuffer::screen->frame_rect( rect.x, rect.y, rect.w, rect.h, state_.stroke==kBlack );
+		return;
+	}
+
+	set_color( state_.stroke );
 	SDL_RenderDrawRect( gRenderer, &rect );
 }
 
 void graphics::fill_rect( const rect & r )
 {
-	set_color( state_.fill );
-
 	SDL_Rect rect;
 	rect.x = (int)r.o.x+state_.origin.x;
 	rect.y = (int)r.o.y+state_.origin.y;
 	rect.w = (int)r.s.w;
 	rect.h = (int)r.s.h;
+	if (framebuffer::screen)
+	{
+		framebuffer::screen->fill_rect( rect.x, rect.y, rect.w, rect.h, state_.fill==kBlack );
+		return;
+	}
+
+	set_color( state_.fill );
 	SDL_RenderFillRect( gRenderer, &rect );
 }
 
@@ -44,23 +54,102 @@ void graphics::move_to( point p )
 	state_.location = state_.origin+p;
 }
 
-void graphics::draw_text( const line &line )
+void graphics::draw_text( const line &line, bool inverted )
 {
     for(auto &word : line)
         for(auto &letter : word.letters)
         {
-            state_.font->draw_letter(state_.location, letter.c);
+            state_.font->draw_letter(state_.location, letter.c, inverted);
             state_.location.x+=letter.spacing;
         }
         
 }
 
+void graphics::draw_text( const char *p, size_t length, bool inverted )
+{
+	for (size_t i=0;i!=length;i++)
+	{
+		state_.font->draw_letter( state_.location, p[i], inverted );
+		state_.location.x += (int)state_.char_interval;
+	}
+}
+
+view_cache::~view_cache()
+{
+	if (texture_)
+		SDL_DestroyTexture( texture_ );
+}
+
+void view_cache::render( graphics &g, const size &s, const std::function<void( graphics & )> &draw )
+{
+	SDL_Rect r{ (int)g.origin().x, (int)g.origin().y, (int)s.w, (int)s.h };
+
+	if (s.w!=size_.w || s.h!=size_.h)
+	{
+		if (texture_)
+			SDL_DestroyTexture( texture_ );
+		texture_ = nullptr;
+		size_ = s;
+		valid_ = false;
+	}
+
+		//	The content is drawn at its place on screen, then grabbed
+	if (auto fb = framebuffer::screen.get())
+	{
+		if (!valid_)
+		{
+			draw( g );
+			bits_ = fb->grab( r.x, r.y, r.w, r.h );
+			valid_ = true;
+		}
+		else
+			fb->blit( bits_, r.x, r.y );
+		return;
+	}
+
+	if (!texture_ && s.w && s.h)
+		texture_ = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, r.w, r.h );
+
+		//	Renderers without target textures just draw everything every frame
+	if (!texture_)
+	{
+		draw( g );
+		return;
+	}
+
+	if (!valid_)
+	{
+		SDL_SetRenderTarget( gRenderer, texture_ );
+		graphics offscreen{};
+		offscreen.reset();
+		draw( offscreen );
+		SDL_SetRenderTarget( gRenderer, nullptr );
+		valid_ = true;
+	}
+
+	SDL_RenderCopy( gRenderer, texture_, nullptr, &r );
+}
+
 void window::draw()
 {
+	if (auto fb = framebuffer::screen.get())
+	{
+		fb->begin_frame();
+		fb->clear();
+		auto start = SDL_GetPerformanceCounter();
+		root_.draw( graphics_ );
+		draw_time_ = (SDL_GetPerformanceCounter()-start)*1000.0/SDL_GetPerformanceFrequency();
+		fb->end_frame();
+		fb->present();
+		return;
+	}
+
 	set_color( graphics::kWhite );
 	SDL_RenderClear( gRenderer );
 
+	auto start = SDL_GetPerformanceCounter();
 	root_.draw( graphics_ );
+	draw_time_ = (SDL_GetPerformanceCounter()-start)*1000.0/SDL_GetPerformanceFrequency();
 
 	SDL_RenderPresent( gRenderer );
 }
@@ -11,6 +11,7 @@
 #include "core.hpp"
 #include <vector>
 #include <memory>
+#include <functional>
 
 #include "image.hpp"
 #include "font.hpp"
@@ -38,9 +39,9 @@ struct token
 
 struct styled_string
 {
-    const std::string text;
+    std::string text;
     const font *font;
-    const bool inverted;
+    bool inverted;
 };
 
 
@@ -182,8 +183,9 @@ public:
 	void frame_rect( const rect & r );
 	void fill_rect( const rect & r );
 	void set_origin( const point &p ) { state_.origin += p; }
+	point origin() const { return state_.origin; }
 	void set_font( const font *font ) { state_.font = font; }
-    void draw_text( const line &line);
+    void draw_text( const line &line, bool inverted=false );
 	void move_to( point p );
 
 	void push() { states_.push_back( state_ ); }
@@ -192,6 +194,29 @@ public:
 	void draw_text( const char *p, size_t length, bool inverted );
 };
 
+///	An offscreen copy of what a view draws inside its bounds, for content that rarely changes
+///	It is composited once, then drawn with a single copy per frame
+///	The owner calls invalidate() when the content changes. A new size composites it again too
+class view_cache
+{
+	SDL_Texture *texture_ = nullptr;	///	Of the cached size
+	bitmap bits_;						///	The 1-bit backend keeps a grab of the screen instead
+	size size_{ 0,0 };
+	bool valid_ = false;
+
+public:
+	view_cache() {}
+	view_cache( const view_cache & ) = delete;
+	view_cache &operator=( const view_cache & ) = delete;
+	~view_cache();
+
+	void invalidate() { valid_ = false; }
+
+	///	Draws the content at the origin of 'g', calling 'draw' first to composite it if needed
+	///	'draw' gets a graphics with its origin at the top left of the content
+	void render( graphics &g, const size &s, const std::function<void( graphics & )> &draw );
+};
+
 ///	A simple UI framework for towermac
 ///	Subset of NeXTstep's AppKit: nested views, buttons, text. Views can have borders.
 
@@ -212,6 +237,8 @@ protected:
 	bool has_fill = false;
 	graphics::color background_color = graphics::kWhite;
 
+	bool hidden_ = false;	///	Hidden views and their subviews are not drawn
+
 public:
 	view( const rect &b ) : bounds_{b} {}
 	view( const size &s ) : bounds_{ {0,0},s } {}
@@ -227,6 +254,8 @@ public:
 	void set_border( bool border=true ) { border_width = border?1:0; }
 	void set_opaque( bool opaque=true ) { has_fill = opaque; }
 	void set_background_color( graphics::color color ) { background_color = color; }
+	void set_hidden( bool hidden=true ) { hidden_ = hidden; }
+	bool is_hidden() const { return hidden_; }
 
 	void add( view *v, point origin )
 	{
@@ -254,6 +283,8 @@ public:
 
 	void draw( graphics &g )
 	{
+		if (hidden_)
+			return;
 		g.push();
 		g.set_origin( origin_ );
 		draw_self( g );
@@ -289,10 +320,21 @@ class button : public view
 		const font *font = nullptr;
 		bool inverted = false;		//	White on black
 		
-		size best_size() const { return { font->measure_text( text.c_str() ), 7 }; }
+			//	Each letter is followed by one pixel, as graphics::draw_text does
+		size best_size() const { return { font->measure_text( text.c_str() )+text.size(), 7 }; }
 	}	cells_[2];
 
 	int state_ = kStateNormal;
+
+	view_cache caches_[2];		///	The content of each state, drawn once
+
+	void invalidate( int state )
+	{
+		if (state==kStateNormal || state==kStateBoth)
+			caches_[kStateNormal].invalidate();
+		if (state==kStateSelected || state==kStateBoth)
+			caches_[kStateSelected].invalidate();
+	}
 	
 public:
 	button( const std::string &t, const font *f=nullptr ) : view{{{0,0},{0,0}}}
@@ -322,6 +364,7 @@ public:
 		{
 			cells_[kStateSelected].text = text;
 		}
+		invalidate( state );
 	}
 	
 	void set_font( const font *font, int state=kStateBoth )
@@ -336,6 +379,7 @@ public:
 		{
 			cells_[kStateSelected].font = font;
 		}
+		invalidate( state );
 	}
 	void set_inverted( bool inverted, int state=kStateBoth )
 	{
@@ -347,6 +391,7 @@ public:
 		{
 			cells_[kStateSelected].inverted = inverted;
 		}
+		invalidate( state );
 	}
 
 	void set_background_color( graphics::color background_color, int state=kStateBoth )
@@ -359,6 +404,7 @@ public:
 		{
 			cells_[kStateSelected].background_color = background_color;
 		}
+		invalidate( state );
 	}
 	
 	void size_to_fit()
@@ -372,19 +418,23 @@ public:
 	{
 		view::draw_self( g );
 
-		g.set_fill( cells_[state_].background_color );
-		g.fill_rect( bounds_ );
+		auto &cell = cells_[state_];
+		caches_[state_].render( g, bounds_.s, [&]( graphics &g )
+		{
+			g.set_fill( cell.background_color );
+			g.fill_rect( bounds_ );
 
-		g.set_font( cells_[state_].font );
-		g.move_to( {2,1} );
-		//g.draw_text( cells_[state_].text, cells_[state_].inverted );
+			g.set_font( cell.font );
+			g.move_to( {2,1} );
+			g.draw_text( cell.text.c_str(), cell.text.size(), cell.inverted );
+		} );
 	}
 };
 
 ///	This class specifies how a text is layed out on the screen
 class layout
 {
-	const styled_string &text_;	///	The text we want to lay out
+	const styled_string *text_;	///	The text we want to lay out
 	size_t width_;		///	Width in pixel of each line of text
 	typedef enum
 	{
@@ -479,7 +529,7 @@ protected:
 	std::vector<line> lines_;
 
 public:
-	layout( const styled_string &text, size_t width ) : text_(text)
+	layout( const styled_string &text, size_t width ) : text_(&text)
 	{
         std::vector<token> tokens;
         tokenize(tokens, text);
@@ -499,27 +549,40 @@ public:
 	size_t line_count() const { return lines_.size(); }
     size_t line_width() const { return width_; }
 
-	void render( graphics g )
+	void render( graphics &g )
 	{
-		g.set_font( text_.font );
+		g.push();
+		g.set_font( text_->font );
 		
         size_t h = 1;
 		for (auto &line : lines_)
 		{
 			g.move_to( { 3, h } );
-			g.draw_text( line );
+			g.draw_text( line, text_->inverted );
             h+=9;
 		}
+		g.pop();
 	}
 };
 
 class static_text : public view
 {
 	styled_string text_;
+	size_t width_;		///	Asked for, the text may end up narrower
 	
 	layout layout_;
+	view_cache cache_;	///	The laid out text, drawn once
+
+	///	Lays the text out again, after a change
+	void relayout()
+	{
+		layout_ = layout{ text_, width_-6 };
+		size_to_fit();
+		cache_.invalidate();
+	}
+
 public:
-	static_text( styled_string text, size_t width ) : view{{{0,0},{width,0}}}, text_{text}, layout_{text_,bounds_.s.w-6}
+	static_text( styled_string text, size_t width ) : view{{{0,0},{width,0}}}, text_{text}, width_{ width }, layout_{text_,bounds_.s.w-6}
 	{
 		set_border( true );
 		set_opaque( false );	///	Superclass does not fill
@@ -531,14 +594,22 @@ public:
         bounds_.s.w = layout_.line_width()+6;
 	}
 
+	void set_text( const std::string &text ) { text_.text = text; relayout(); }
+	void set_font( const font *font ) { text_.font = font; relayout(); }
+	void set_width( size_t width ) { width_ = width; relayout(); }
+	void set_background_color( graphics::color color ) { view::set_background_color( color ); cache_.invalidate(); }
+
 	virtual void draw_self( graphics &g )
 	{
 		view::draw_self( g );
 
-		g.set_fill( background_color );
-		g.fill_rect( bounds_ );
+		cache_.render( g, bounds_.s, [&]( graphics &g )
+		{
+			g.set_fill( background_color );
+			g.fill_rect( bounds_ );
 
-		layout_.render( g );
+			layout_.render( g );
+		} );
 	}
 };
 
@@ -546,6 +617,7 @@ class window
 {
 	view root_;
 	graphics graphics_;
+	double draw_time_ = 0;		///	Of the last frame, in ms
 	
 	window( const rect &r ) : root_{ r }, graphics_{} {}
 public:
@@ -559,6 +631,9 @@ public:
 	view &root() { return root_; }
 	
 	void draw();
+
+	///	Time spent drawing the views of the last frame, in ms (clearing and presenting excluded)
+	double draw_time() const { return draw_time_; }
 };
 
 #endif